@@ -6,12 +6,79 @@ in vec3 normals;
 
 out vec4 fragColour;
 
-vec3 lightDirection = normalize(vec3(0.8, -0.5, 0.6));
+#ifdef POINT_LIGHTS
+in vec3 worldPosition;
+
+// Uniforms shared by every draw of the frame
+layout (std140, binding = 0) uniform FrameUniforms {
+    mat4 VP_matrix;
+    // Clusters per pixel along x and y, and the scale and bias taking the log of the view depth to the depth slice
+    vec4 cluster_scale;
+    // Clusters along x, y and z, and the number of point lights
+    uvec4 cluster_count;
+};
+
+// Point lights in world coordinates, lighting everything within radius of their position
+struct PointLight {
+    vec3 position;
+    float radius;
+    vec3 colour;
+    float intensity;
+};
+
+layout (std430, binding = 3) readonly buffer Lights {
+    PointLight lights[];
+};
+
+// First index in light_indices and number of lights of every cluster, column first, then row, then slice
+layout (std430, binding = 4) readonly buffer Clusters {
+    uvec2 clusters[];
+};
+
+layout (std430, binding = 5) readonly buffer LightIndices {
+    uint light_indices[];
+};
+#endif
+
+// Direction the light shines in, unless a variant defines another one
+#ifndef LIGHT_DIRECTION
+#define LIGHT_DIRECTION vec3(0.8, -0.5, 0.6)
+#endif
+
+vec3 lightDirection = normalize(LIGHT_DIRECTION);
+
+
+#ifdef POINT_LIGHTS
+// Lambertian lighting by the point lights of the fragment's cluster, fading out smoothly towards their radius
+vec3 pointLighting()
+{
+    // gl_FragCoord.w is 1 / w of the clip space position, and w is the view depth
+    float depth = 1.0 / gl_FragCoord.w;
+    float slice = max(floor(log(depth) * cluster_scale.z + cluster_scale.w), 0.0);
+    uvec3 cluster = min(uvec3(uvec2(gl_FragCoord.xy * cluster_scale.xy), uint(slice)), cluster_count.xyz - 1u);
+    uvec2 range = clusters[(cluster.z * cluster_count.y + cluster.y) * cluster_count.x + cluster.x];
+
+    vec3 lighting = vec3(0.0);
+    for (uint i = range.x; i < range.x + range.y; i++)
+    {
+        PointLight light = lights[light_indices[i]];
+        vec3 toLight = light.position - worldPosition;
+        float distance = max(length(toLight), 0.0001);
+        float falloff = clamp(1.0 - (distance * distance) / (light.radius * light.radius), 0.0, 1.0);
+        lighting += light.colour * light.intensity * falloff * falloff * max(0, dot(normals, toLight / distance));
+    }
+    return lighting;
+}
+#endif
 
 
 void main()
 {
     // Lambertian lighting model
-    fragColour = vec4(vertexColour.rgb * max(0, dot(normals, -lightDirection)), vertexColour.a);
+    vec3 lighting = vec3(max(0, dot(normals, -lightDirection)));
+#ifdef POINT_LIGHTS
+    lighting += pointLighting();
+#endif
+    fragColour = vec4(vertexColour.rgb * lighting, vertexColour.a);
 
 }
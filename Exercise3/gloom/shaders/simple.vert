@@ -1,21 +1,74 @@
 #version 430 core
 
+// Variants, defined when the program is compiled (see Gloom::ShaderVariants):
+//   (none)     one node per draw, matrix_index selects its world matrix
+//   INSTANCED  one mesh for many nodes per draw, instance_offset selects the first world matrix
+//   INDIRECT   many meshes per multi-draw call, the first world matrix of every command is looked up by gl_DrawID
+// and, with any of them:
+//   POINT_LIGHTS  lit by the point lights of the fragment's cluster as well (see simple.frag)
+#ifdef INDIRECT
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+
 // Inputs and outputs
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec4 colour;
 layout (location = 2) in vec3 normal;
 
-uniform layout (location = 3) mat4 MVP_matrix;
-uniform layout (location = 4) mat4 M_matrix;
+// Uniforms shared by every draw of the frame
+layout (std140, binding = 0) uniform FrameUniforms {
+    mat4 VP_matrix;
+    vec4 cluster_scale;
+    uvec4 cluster_count;
+};
+
+#if defined(INDIRECT)
+// Index in instance_offsets of the first command of this multi-draw call
+uniform layout (location = 6) uint draw_offset;
+#elif defined(INSTANCED)
+// Index of the first instance of this draw in M_matrices
+uniform layout (location = 5) uint instance_offset;
+#else
+// Index of this draw's world matrix in M_matrices
+uniform layout (location = 4) uint matrix_index;
+#endif
+
+// World matrices of all nodes drawn this frame
+layout (std430, binding = 1) readonly buffer InstanceMatrices {
+    mat4 M_matrices[];
+};
+
+#ifdef INDIRECT
+// Index of the first instance of every draw command in M_matrices
+layout (std430, binding = 2) readonly buffer DrawData {
+    uint instance_offsets[];
+};
+#endif
 
 out vec4 vertexColour;
 out vec3 normals;
+#ifdef POINT_LIGHTS
+out vec3 worldPosition;
+#endif
 
 void main()
 {
+#if defined(INDIRECT)
+    mat4 M_matrix = M_matrices[instance_offsets[draw_offset + gl_DrawIDARB] + gl_InstanceID];
+#elif defined(INSTANCED)
+    mat4 M_matrix = M_matrices[instance_offset + gl_InstanceID];
+#else
+    mat4 M_matrix = M_matrices[matrix_index];
+#endif
+
     vertexColour = vec4(colour);
 
     normals = normalize(mat3(M_matrix) * normal);
 
-    gl_Position = MVP_matrix * vec4(position, 1.0f);
+    vec4 world_position = M_matrix * vec4(position, 1.0f);
+#ifdef POINT_LIGHTS
+    worldPosition = world_position.xyz;
+#endif
+
+    gl_Position = VP_matrix * world_position;
 }
@@ -3,6 +3,8 @@
 #include <exception>
 #include "sceneGraph.hpp"
 #include "toolbox.hpp"
+#include "profiler.hpp"
+#include "memoryTracker.hpp"
 
 void split(std::string &target, const char delimiter, std::vector<std::string> &res, unsigned int* outLength)
 {
@@ -20,6 +22,7 @@ void split(std::string &target, const char delimiter, std::vector<std::string> &
 
 std::vector<VectorMesh> loadWavefront(std::string const srcFile, bool quiet)
 {
+	PROFILE_ZONE("Load Wavefront");
 	std::vector<VectorMesh> meshes;
 	std::ifstream objFile(srcFile);
 	std::vector<float4> vertices;
@@ -183,6 +186,14 @@ std::vector<VectorMesh> loadWavefront(std::string const srcFile, bool quiet)
 		throw std::runtime_error("Reading OBJ file failed. This is usually because the operating system can't find it. Check if the relative path (to your terminal's working directory) is correct.");
 	}
 
+	// Everything held while loading is freed once the meshes are converted, so it only shows in the high-water mark
+	uint64_t scratch_bytes = vertices.capacity() * sizeof(float4) + normals.capacity() * sizeof(float3);
+	for (const VectorMesh& mesh : meshes) {
+		scratch_bytes += mesh.vertices.capacity() * sizeof(float4) + mesh.colours.capacity() * sizeof(float4)
+		               + mesh.normals.capacity() * sizeof(float3) + mesh.indices.capacity() * sizeof(unsigned int);
+	}
+	memoryTrackTransient(MEMORY_CPU, "loader/scratch", scratch_bytes);
+
 	return meshes;
 }
 
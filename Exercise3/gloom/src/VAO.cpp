@@ -1,8 +1,10 @@
 #include "VAO.hpp"
+#include "profiler.hpp"
 
 /* Creates a Vertex Array Object containing triangles */
 unsigned int createVAO(std::vector<float> vertexCoordinates, std::vector<unsigned int> indices,
                        std::vector<float> colours, std::vector<float> normals) {
+    PROFILE_ZONE("Create VAO");
 
     // Generating a single Vertex Array Object (VAO) and binding it
     unsigned int vertexArrayID = 0;
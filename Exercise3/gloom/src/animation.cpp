@@ -0,0 +1,142 @@
+#include "animation.hpp"
+#include "transformMath.hpp"
+
+#include <cmath>
+
+
+size_t AnimationChannels::addChannel(SceneNodeHandle target, AnimationProperty property, AnimationAxis axis, AnimationCurve curve,
+                                     float rate, float phase, float amplitude, float base) {
+    targets.push_back(target);
+    properties.push_back((unsigned char)property);
+    axes.push_back((unsigned char)axis);
+    curves.push_back((unsigned char)curve);
+    rates.push_back(rate);
+    phases.push_back(phase);
+    amplitudes.push_back(amplitude);
+    bases.push_back(base);
+    wraps.push_back((curve == CURVE_LINEAR) ? 0.0f : 1.0f);
+
+    // A new channel starts at its value at the last evaluated time, so it is not interpolated from zero
+    const double two_pi = 6.28318530717958647692;
+    double argument = (double)rate * evaluatedTime + (double)phase;
+    float value;
+    if (curve == CURVE_SINE) {
+        value = base + amplitude * (float)std::sin(argument);
+    } else if (curve == CURVE_SPIN) {
+        value = base + amplitude * (float)(argument - two_pi * std::floor(argument / two_pi));
+    } else {
+        value = base + amplitude * (float)argument;
+    }
+    values.push_back(value);
+    previousValues.push_back(value);
+
+    return targets.size() - 1;
+}
+
+/* Rounds down using the 2^52 + 2^51 rounding trick instead of a call to floor() or a comparison, so that loops using it
+   vectorise with plain SSE2. Exact for |value| < 2^51 except that integers may round to value - 1, which only means
+   a wrapped angle comes out as 2pi instead of 0 */
+static inline double floor_vectorisable(double value) {
+    const double shifter = 6755399441055744.0;
+    return ((value - 0.5) + shifter) - shifter;
+}
+
+void AnimationChannels::evaluate(double time) {
+    const double two_pi = 6.28318530717958647692;
+    size_t count = targets.size();
+
+    previousValues.swap(values);
+    evaluatedTime = time;
+
+    const unsigned char* curve = curves.data();
+    const float* rate = rates.data();
+    const float* phase = phases.data();
+    const float* amplitude = amplitudes.data();
+    const float* base = bases.data();
+    const float* wrap = wraps.data();
+    float* result = values.data();
+
+    // The argument is formed in double precision and wrapped before it is narrowed to float,
+    // so rotations stay exact however large the time gets. The loop has no calls or branches and vectorises.
+    for (size_t i = 0; i < count; i++) {
+        double argument = (double)rate[i] * time + (double)phase[i];
+        double turns = floor_vectorisable(argument / two_pi) * (double)wrap[i];
+
+        result[i] = base[i] + amplitude[i] * (float)(argument - two_pi * turns);
+    }
+
+    // Oscillating channels are rare, so they are corrected afterwards instead of slowing down the main pass
+    for (size_t i = 0; i < count; i++) {
+        if (curve[i] == CURVE_SINE) {
+            double argument = (double)rate[i] * time + (double)phase[i];
+            result[i] = base[i] + amplitude[i] * (float)std::sin(argument);
+        }
+    }
+}
+
+void AnimationChannels::apply(float alpha) {
+    size_t stale = 0;
+    bool interpolate = alpha < 1.0f;
+
+    for (size_t i = 0; i < targets.size(); i++) {
+        SceneNode* node = resolveSceneNode(targets[i]);
+        if (node == nullptr) {
+            stale++;
+            continue;
+        }
+
+        if (properties[i] == ANIMATE_ROTATION) {
+            glm::vec3 rotation = node->rotation;
+            rotation[axes[i]] = interpolate ? interpolateAngle(previousValues[i], values[i], alpha) : values[i];
+            setNodeRotation(node, rotation);
+        } else {
+            glm::vec3 position = node->position;
+            position[axes[i]] = interpolate ? previousValues[i] + (values[i] - previousValues[i]) * alpha : values[i];
+            setNodePosition(node, position);
+        }
+    }
+
+    if (stale > 0 && stale * 2 >= targets.size()) {
+        removeStaleChannels();
+    }
+}
+
+/* Moves the last channel into the removed channel's place */
+void AnimationChannels::removeChannel(size_t channel) {
+    size_t last = targets.size() - 1;
+
+    targets[channel] = targets[last];
+    properties[channel] = properties[last];
+    axes[channel] = axes[last];
+    curves[channel] = curves[last];
+    rates[channel] = rates[last];
+    phases[channel] = phases[last];
+    amplitudes[channel] = amplitudes[last];
+    bases[channel] = bases[last];
+    wraps[channel] = wraps[last];
+    values[channel] = values[last];
+    previousValues[channel] = previousValues[last];
+
+    targets.pop_back();
+    properties.pop_back();
+    axes.pop_back();
+    curves.pop_back();
+    rates.pop_back();
+    phases.pop_back();
+    amplitudes.pop_back();
+    bases.pop_back();
+    wraps.pop_back();
+    values.pop_back();
+    previousValues.pop_back();
+}
+
+void AnimationChannels::removeStaleChannels() {
+    size_t i = 0;
+    while (i < targets.size()) {
+        if (resolveSceneNode(targets[i]) == nullptr) {
+            removeChannel(i);
+        } else {
+            i++;
+        }
+    }
+}
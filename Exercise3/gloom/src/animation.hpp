@@ -0,0 +1,85 @@
+#ifndef ANIMATION_HPP
+#define ANIMATION_HPP
+#pragma once
+
+
+#include <cstddef>
+#include <vector>
+
+// Local headers
+#include "sceneGraph.hpp"
+
+
+// The node property a channel drives
+enum AnimationProperty {
+    ANIMATE_ROTATION,
+    ANIMATE_POSITION
+};
+
+// The component of the property a channel drives
+enum AnimationAxis {
+    ANIMATION_AXIS_X = 0,
+    ANIMATION_AXIS_Y = 1,
+    ANIMATION_AXIS_Z = 2
+};
+
+// How a channel's value follows time, with argument = rate * time + phase:
+//   CURVE_SPIN:   base + amplitude * (argument wrapped to [0, 2pi)), constant speed rotation that does not lose precision over time
+//   CURVE_LINEAR: base + amplitude * argument, constant speed movement
+//   CURVE_SINE:   base + amplitude * sin(argument), oscillation
+enum AnimationCurve {
+    CURVE_SPIN,
+    CURVE_LINEAR,
+    CURVE_SINE
+};
+
+
+// Animation channels stored as structure of arrays.
+// Every channel is evaluated from the absolute time rather than by accumulating steps,
+// so the result at a given time does not depend on the frame rate or how long the program has been running.
+class AnimationChannels {
+public:
+    AnimationChannels() : evaluatedTime(0.0) { }
+
+    // Adds a channel driving one component of the target node's rotation or position and returns its index
+    size_t addChannel(SceneNodeHandle target, AnimationProperty property, AnimationAxis axis, AnimationCurve curve,
+                      float rate, float phase = 0.0f, float amplitude = 1.0f, float base = 0.0f);
+
+    // Computes the value of every channel at the given time in one pass over the channel arrays.
+    // The values of the previous call are kept, so that apply() can interpolate between the last two evaluations.
+    void evaluate(double time);
+
+    // Writes the values computed by evaluate() into the target nodes, interpolated from the previous evaluate()
+    // by alpha in [0, 1]. Rotations are interpolated the shorter way round.
+    // Channels whose node has been destroyed are skipped and removed once they make up half of all channels.
+    void apply(float alpha = 1.0f);
+
+    // Removes all channels whose target node has been destroyed
+    void removeStaleChannels();
+
+    size_t size() const { return targets.size(); }
+    float value(size_t channel) const { return values[channel]; }
+
+private:
+    void removeChannel(size_t channel);
+
+    std::vector<SceneNodeHandle> targets;
+    std::vector<unsigned char> properties;
+    std::vector<unsigned char> axes;
+    std::vector<unsigned char> curves;
+    std::vector<float> rates;
+    std::vector<float> phases;
+    std::vector<float> amplitudes;
+    std::vector<float> bases;
+
+    // 1 for curves whose argument is wrapped to [0, 2pi), 0 otherwise, so the evaluation needs no branch on the curve
+    std::vector<float> wraps;
+
+    // Results of the last and the previous evaluate(), and the time of the last one
+    std::vector<float> values;
+    std::vector<float> previousValues;
+    double evaluatedTime;
+};
+
+
+#endif
@@ -0,0 +1,276 @@
+#include "benchmark.hpp"
+#include "memoryTracker.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+void CameraPath::addKeyframe(double time, const CameraPose& pose) {
+    times.push_back(time);
+    poses.push_back(pose);
+}
+
+bool CameraPath::load(const std::string& filename) {
+    FILE* file = fopen(filename.c_str(), "r");
+    if (file == nullptr) {
+        return false;
+    }
+
+    times.clear();
+    poses.clear();
+
+    double time;
+    CameraPose pose;
+    while (fscanf(file, "%lf %f %f %f %f %f", &time, &pose.position.x, &pose.position.y, &pose.position.z,
+                  &pose.pitch, &pose.yaw) == 6) {
+        // A recording holds a pose per frame, so duplicates from frames without time passing are dropped
+        if (times.empty() || time > times.back()) {
+            addKeyframe(time, pose);
+        }
+    }
+    fclose(file);
+
+    return !times.empty();
+}
+
+CameraPath CameraPath::scripted() {
+    // Positions are the negated camera positions used by the view matrix in program.cpp
+    const double keyframes[][6] = {
+        {  0.0,   0.0f, -25.0f,  -80.0f, 0.5f,  0.0f },
+        {  4.0,   0.0f, -25.0f,  -80.0f, 0.5f,  1.2f },
+        {  8.0,   0.0f, -25.0f,  -80.0f, 0.5f, -1.2f },
+        { 12.0,   0.0f, -15.0f,  -40.0f, 0.3f,  0.0f },
+        { 16.0,   0.0f, -40.0f, -150.0f, 0.6f,  0.0f },
+        { 20.0,  20.0f, -10.0f,  -20.0f, 0.2f,  0.6f },
+        { 24.0,   0.0f, -25.0f,  -80.0f, 0.5f,  0.0f }
+    };
+
+    CameraPath path;
+    for (const double* keyframe : keyframes) {
+        CameraPose pose;
+        pose.position = glm::vec3((float)keyframe[1], (float)keyframe[2], (float)keyframe[3]);
+        pose.pitch = (float)keyframe[4];
+        pose.yaw = (float)keyframe[5];
+        path.addKeyframe(keyframe[0], pose);
+    }
+    return path;
+}
+
+CameraPose CameraPath::sample(double time) const {
+    if (times.empty()) {
+        CameraPose pose = { glm::vec3(0.0f), 0.0f, 0.0f };
+        return pose;
+    }
+    if (times.size() == 1 || duration() <= 0.0) {
+        return poses.front();
+    }
+    time = std::fmod(std::max(time, 0.0), duration());
+
+    size_t next = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+    next = std::min(std::max<size_t>(next, 1), times.size() - 1);
+    size_t previous = next - 1;
+
+    float alpha = (float)((time - times[previous]) / (times[next] - times[previous]));
+    const CameraPose& from = poses[previous];
+    const CameraPose& to = poses[next];
+
+    CameraPose pose;
+    pose.position = glm::mix(from.position, to.position, alpha);
+    pose.pitch = from.pitch + (to.pitch - from.pitch) * alpha;
+    pose.yaw = from.yaw + (to.yaw - from.yaw) * alpha;
+    return pose;
+}
+
+
+CameraRecorder::~CameraRecorder() {
+    if (file != nullptr) {
+        fclose(file);
+    }
+}
+
+bool CameraRecorder::open(const std::string& filename) {
+    file = fopen(filename.c_str(), "w");
+    return file != nullptr;
+}
+
+void CameraRecorder::record(double time, const CameraPose& pose) {
+    if (file != nullptr) {
+        fprintf(file, "%.6f %.6f %.6f %.6f %.6f %.6f\n", time, pose.position.x, pose.position.y, pose.position.z,
+                pose.pitch, pose.yaw);
+    }
+}
+
+
+void BenchmarkRecorder::addFrame(const FrameSample& sample) {
+    if (skipFrames > 0) {
+        skipFrames--;
+        return;
+    }
+    samples.push_back(sample);
+}
+
+// Summary of one measured quantity over all frames, in milliseconds
+struct Distribution {
+    double mean;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+};
+
+/* Nearest rank percentile of sorted values */
+static double percentile(const std::vector<double>& values, double fraction) {
+    size_t rank = (size_t)std::ceil(fraction * values.size());
+    return values[std::min(std::max<size_t>(rank, 1), values.size()) - 1];
+}
+
+/* Mean, percentiles and maximum of a member of every sample */
+static Distribution summarise(const std::vector<FrameSample>& samples, double FrameSample::* member) {
+    Distribution distribution = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+    if (samples.empty()) {
+        return distribution;
+    }
+
+    std::vector<double> values;
+    values.reserve(samples.size());
+    for (const FrameSample& sample : samples) {
+        values.push_back(sample.*member * 1000.0);
+    }
+    std::sort(values.begin(), values.end());
+
+    double sum = 0.0;
+    for (double value : values) {
+        sum += value;
+    }
+
+    distribution.mean = sum / values.size();
+    distribution.p50 = percentile(values, 0.50);
+    distribution.p95 = percentile(values, 0.95);
+    distribution.p99 = percentile(values, 0.99);
+    distribution.max = values.back();
+    return distribution;
+}
+
+/* Average of a counter over all samples */
+template <typename Count>
+static double average(const std::vector<FrameSample>& samples, Count FrameSample::* member) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    double sum = 0.0;
+    for (const FrameSample& sample : samples) {
+        sum += sample.*member;
+    }
+    return sum / samples.size();
+}
+
+static void write_distribution(FILE* file, const char* indent, const char* name, const Distribution& distribution,
+                               const char* separator) {
+    fprintf(file, "%s\"%s\": { \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+            indent, name, distribution.mean, distribution.p50, distribution.p95, distribution.p99, distribution.max, separator);
+}
+
+/* Writes a string with the characters JSON does not allow unescaped escaped */
+static void write_json_string(FILE* file, const std::string& text) {
+    fputc('"', file);
+    for (char character : text) {
+        if (character == '"' || character == '\\') {
+            fputc('\\', file);
+            fputc(character, file);
+        } else if ((unsigned char)character < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned int)(unsigned char)character);
+        } else {
+            fputc(character, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/* Writes the memory totals and every category as the members of a JSON object, each line starting with indent */
+static void write_memory(FILE* file, const char* indent) {
+    std::vector<MemoryCategory> categories = memoryCategories();
+    const char* domain_keys[] = { "cpu", "gpu" };
+
+    for (int domain = MEMORY_CPU; domain <= MEMORY_GPU; domain++) {
+        fprintf(file, "%s\"%s\": {\n", indent, domain_keys[domain]);
+        fprintf(file, "%s  \"bytes\": %llu,\n", indent, (unsigned long long)memoryTotal((MemoryDomain)domain));
+        fprintf(file, "%s  \"peak_bytes\": %llu,\n", indent, (unsigned long long)memoryPeak((MemoryDomain)domain));
+        fprintf(file, "%s  \"categories\": {", indent);
+
+        bool first = true;
+        for (const MemoryCategory& category : categories) {
+            if (category.domain != domain) {
+                continue;
+            }
+            // Category names come from mesh names in OBJ files, so they may hold anything
+            fprintf(file, "%s\n%s    ", first ? "" : ",", indent);
+            write_json_string(file, category.name);
+            fprintf(file, ": { \"bytes\": %llu, \"peak_bytes\": %llu }",
+                    (unsigned long long)category.bytes, (unsigned long long)category.peakBytes);
+            first = false;
+        }
+        fprintf(file, "\n%s  }\n", indent);
+        fprintf(file, "%s}%s\n", indent, (domain == MEMORY_GPU) ? "" : ",");
+    }
+}
+
+bool BenchmarkRecorder::writeReport(const std::string& filename, const BenchmarkSettings& settings) const {
+    FILE* file = fopen(filename.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"settings\": {\n");
+    fprintf(file, "    \"frames\": %u,\n", settings.frames);
+    fprintf(file, "    \"warmup_frames\": %u,\n", settings.warmupFrames);
+    fprintf(file, "    \"helicopters\": %u,\n", settings.helicopters);
+    fprintf(file, "    \"frame_seconds\": %.6f,\n", settings.frameSeconds);
+    fprintf(file, "    \"camera_path\": ");
+    write_json_string(file, settings.cameraPath);
+    fprintf(file, ",\n    \"render_path\": ");
+    write_json_string(file, settings.renderPath);
+    fprintf(file, ",\n    \"renderer\": ");
+    write_json_string(file, settings.renderer);
+    fprintf(file, "\n  },\n");
+
+    fprintf(file, "  \"measured_frames\": %u,\n", (unsigned int)samples.size());
+    write_distribution(file, "  ", "frame_time_ms", summarise(samples, &FrameSample::frameSeconds), ",");
+
+    fprintf(file, "  \"phases_ms\": {\n");
+    write_distribution(file, "    ", "wait_for_simulation", summarise(samples, &FrameSample::waitSeconds), ",");
+    write_distribution(file, "    ", "occlusion", summarise(samples, &FrameSample::occlusionSeconds), ",");
+    write_distribution(file, "    ", "culling", summarise(samples, &FrameSample::cullingSeconds), ",");
+    write_distribution(file, "    ", "submit", summarise(samples, &FrameSample::submitSeconds), ",");
+    write_distribution(file, "    ", "present", summarise(samples, &FrameSample::presentSeconds), ",");
+    write_distribution(file, "    ", "simulation_worker", summarise(samples, &FrameSample::simulateSeconds), "");
+    fprintf(file, "  },\n");
+
+    fprintf(file, "  \"draws_per_frame\": {\n");
+    fprintf(file, "    \"drawn_nodes\": %.2f,\n", average(samples, &FrameSample::drawnNodes));
+    fprintf(file, "    \"culled_nodes\": %.2f,\n", average(samples, &FrameSample::culledNodes));
+    fprintf(file, "    \"occluded_nodes\": %.2f,\n", average(samples, &FrameSample::occludedNodes));
+    fprintf(file, "    \"draw_calls\": %.2f,\n", average(samples, &FrameSample::drawCalls));
+    fprintf(file, "    \"draw_commands\": %.2f,\n", average(samples, &FrameSample::drawCommands));
+    fprintf(file, "    \"triangles\": %.2f,\n", average(samples, &FrameSample::triangles));
+    fprintf(file, "    \"program_binds\": %.2f,\n", average(samples, &FrameSample::programBinds));
+    fprintf(file, "    \"vertex_array_binds\": %.2f,\n", average(samples, &FrameSample::vertexArrayBinds));
+    fprintf(file, "    \"uniform_uploads\": %.2f,\n", average(samples, &FrameSample::uniformUploads));
+    fprintf(file, "    \"bytes_uploaded\": %.2f\n", average(samples, &FrameSample::bytesUploaded));
+    fprintf(file, "  },\n");
+
+    fprintf(file, "  \"memory\": {\n");
+    write_memory(file, "    ");
+    fprintf(file, "  }\n");
+    fprintf(file, "}\n");
+
+    bool written = !ferror(file);
+    fclose(file);
+    return written;
+}
+
+void BenchmarkRecorder::printSummary() const {
+    Distribution frame_time = summarise(samples, &FrameSample::frameSeconds);
+    printf("Benchmark: %u frames, CPU frame time p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+           (unsigned int)samples.size(), frame_time.p50, frame_time.p95, frame_time.p99, frame_time.max);
+}
@@ -0,0 +1,125 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+#pragma once
+
+
+// System headers
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+// Where the camera is and which way it looks, as moved by the keyboard in program.cpp: the negated eye position,
+// and the pitch about the x axis applied after the yaw about the y axis
+struct CameraPose {
+    glm::vec3 position;
+    float pitch;
+    float yaw;
+};
+
+// Camera poses at increasing times, linearly interpolated in between. The path starts over after the last one.
+// Drives the camera in benchmark runs so that every run sees exactly the same views.
+class CameraPath {
+public:
+    void addKeyframe(double time, const CameraPose& pose);
+
+    // Reads keyframes written by CameraRecorder, one "time x y z pitch yaw" line each. Returns false if the file
+    // cannot be read or holds no keyframes.
+    bool load(const std::string& filename);
+
+    // A fixed flight around the scene that looks over the terrain, along the valley and up close at the helicopters
+    static CameraPath scripted();
+
+    CameraPose sample(double time) const;
+
+    bool empty() const { return times.empty(); }
+    double duration() const { return times.empty() ? 0.0 : times.back(); }
+
+private:
+    std::vector<double> times;
+    std::vector<CameraPose> poses;
+};
+
+// Writes the camera pose of every frame to a file that CameraPath::load() reads, to record a path interactively
+class CameraRecorder {
+public:
+    CameraRecorder() : file(nullptr) { }
+    ~CameraRecorder();
+
+    bool open(const std::string& filename);
+    void record(double time, const CameraPose& pose);
+
+private:
+    CameraRecorder(CameraRecorder const &) = delete;
+    CameraRecorder & operator =(CameraRecorder const &) = delete;
+
+    FILE* file;
+};
+
+
+// Time spent in the parts of one frame, and what it drew
+struct FrameSample {
+    // Main thread, from picking up the snapshot to the frame being finished or swapped
+    double frameSeconds;
+
+    // Main thread: waiting for the simulation, rasterising occluders, culling and queueing, submitting, finishing or swapping
+    double waitSeconds;
+    double occlusionSeconds;
+    double cullingSeconds;
+    double submitSeconds;
+    double presentSeconds;
+
+    // Worker thread, overlapping the previous frame's main thread work
+    double simulateSeconds;
+
+    unsigned int drawnNodes;
+    unsigned int culledNodes;
+    unsigned int occludedNodes;
+
+    // The renderer's counters of the frame (see renderStats.hpp)
+    unsigned int drawCalls;
+    unsigned int drawCommands;
+    uint64_t triangles;
+    unsigned int programBinds;
+    unsigned int vertexArrayBinds;
+    unsigned int uniformUploads;
+    uint64_t bytesUploaded;
+};
+
+// Describes the run in the report, so runs can be compared across commits and machines
+struct BenchmarkSettings {
+    unsigned int frames;
+    unsigned int warmupFrames;
+    unsigned int helicopters;
+    double frameSeconds;
+    std::string cameraPath;
+    std::string renderPath;
+    std::string renderer;
+};
+
+// Collects the samples of every frame of a benchmark run and summarises them
+class BenchmarkRecorder {
+public:
+    // The first warmupFrames frames (shader compilation, buffers growing) are left out of the report
+    explicit BenchmarkRecorder(unsigned int warmupFrames = 0) : skipFrames(warmupFrames) { }
+
+    void addFrame(const FrameSample& sample);
+    size_t frameCount() const { return samples.size(); }
+
+    // Writes the report as JSON: percentiles of the CPU frame time, a breakdown by phase, average draw statistics
+    // and the memory tracked so far with its high-water marks
+    bool writeReport(const std::string& filename, const BenchmarkSettings& settings) const;
+
+    // Prints the frame time percentiles to stdout
+    void printSummary() const;
+
+private:
+    unsigned int skipFrames;
+    std::vector<FrameSample> samples;
+};
+
+
+#endif
@@ -0,0 +1,132 @@
+#include "bounds.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+bool isEmpty(const AABB& box) {
+    return box.min.x > box.max.x;
+}
+
+AABB mergeAABB(const AABB& a, const AABB& b) {
+    return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+}
+
+AABB growAABB(const AABB& box, glm::vec3 point) {
+    return AABB(glm::min(box.min, point), glm::max(box.max, point));
+}
+
+glm::vec3 centerOf(const AABB& box) {
+    return 0.5f * (box.min + box.max);
+}
+
+float surfaceArea(const AABB& box) {
+    if (isEmpty(box)) {
+        return 0.0f;
+    }
+    glm::vec3 extent = box.max - box.min;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+bool overlaps(const AABB& a, const AABB& b) {
+    return a.min.x <= b.max.x && a.max.x >= b.min.x
+        && a.min.y <= b.max.y && a.max.y >= b.min.y
+        && a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+/* Arvo's method: every column of the matrix contributes its smallest and largest product with the box extent */
+AABB transformAABB(const AABB& box, const glm::mat4& matrix) {
+    if (isEmpty(box)) {
+        return box;
+    }
+
+    glm::vec3 translation = glm::vec3(matrix[3]);
+    AABB result(translation, translation);
+
+    for (int column = 0; column < 3; column++) {
+        glm::vec3 axis = glm::vec3(matrix[column]);
+        glm::vec3 a = axis * box.min[column];
+        glm::vec3 b = axis * box.max[column];
+
+        result.min += glm::min(a, b);
+        result.max += glm::max(a, b);
+    }
+    return result;
+}
+
+AABB computeMeshBounds(const Mesh& mesh) {
+    AABB bounds;
+
+    for (size_t i = 0; i + 2 < mesh.vertices.size(); i += 3) {
+        bounds = growAABB(bounds, glm::vec3(mesh.vertices[i], mesh.vertices[i + 1], mesh.vertices[i + 2]));
+    }
+    return bounds;
+}
+
+bool intersectsFrustum(const Gloom::Frustum& frustum, const AABB& box) {
+    return classifyAgainstFrustum(frustum, box) != FRUSTUM_OUTSIDE;
+}
+
+/* With the box as center c and half extent e, the signed distance of its nearest and furthest corner to a plane (n, w)
+   is dot(n, c) + w -/+ dot(|n|, e). The box is outside if the furthest corner is behind any plane,
+   and inside if the nearest corner is in front of all of them. */
+#if defined(SIMD_SSE)
+FrustumTest classifyAgainstFrustum(const Gloom::Frustum& frustum, const AABB& box) {
+    if (isEmpty(box)) {
+        return FRUSTUM_OUTSIDE;
+    }
+    glm::vec3 center = 0.5f * (box.max + box.min);
+    glm::vec3 extent = 0.5f * (box.max - box.min);
+
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    const __m128 center_x = _mm_set1_ps(center.x), center_y = _mm_set1_ps(center.y), center_z = _mm_set1_ps(center.z);
+    const __m128 extent_x = _mm_set1_ps(extent.x), extent_y = _mm_set1_ps(extent.y), extent_z = _mm_set1_ps(extent.z);
+
+    __m128 outside = _mm_setzero_ps();
+    __m128 straddling = _mm_setzero_ps();
+
+    for (int i = 0; i < 8; i += 4) {
+        __m128 x = _mm_load_ps(frustum.planeX + i);
+        __m128 y = _mm_load_ps(frustum.planeY + i);
+        __m128 z = _mm_load_ps(frustum.planeZ + i);
+
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, center_x), _mm_mul_ps(y, center_y)),
+                                     _mm_add_ps(_mm_mul_ps(z, center_z), _mm_load_ps(frustum.planeW + i)));
+        __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign_mask, x), extent_x),
+                                              _mm_mul_ps(_mm_andnot_ps(sign_mask, y), extent_y)),
+                                   _mm_mul_ps(_mm_andnot_ps(sign_mask, z), extent_z));
+
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        straddling = _mm_or_ps(straddling, _mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps()));
+    }
+
+    if (_mm_movemask_ps(outside) != 0) {
+        return FRUSTUM_OUTSIDE;
+    }
+    return (_mm_movemask_ps(straddling) != 0) ? FRUSTUM_INTERSECTS : FRUSTUM_INSIDE;
+}
+#else
+FrustumTest classifyAgainstFrustum(const Gloom::Frustum& frustum, const AABB& box) {
+    if (isEmpty(box)) {
+        return FRUSTUM_OUTSIDE;
+    }
+    glm::vec3 center = 0.5f * (box.max + box.min);
+    glm::vec3 extent = 0.5f * (box.max - box.min);
+    FrustumTest result = FRUSTUM_INSIDE;
+
+    for (int i = 0; i < 6; i++) {
+        const glm::vec4& plane = frustum.planes[i];
+        float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+        float radius = std::fabs(plane.x) * extent.x + std::fabs(plane.y) * extent.y + std::fabs(plane.z) * extent.z;
+
+        if (distance + radius < 0.0f) {
+            return FRUSTUM_OUTSIDE;
+        }
+        if (distance - radius < 0.0f) {
+            result = FRUSTUM_INTERSECTS;
+        }
+    }
+    return result;
+}
+#endif
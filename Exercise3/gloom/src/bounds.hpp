@@ -0,0 +1,54 @@
+#ifndef BOUNDS_HPP
+#define BOUNDS_HPP
+#pragma once
+
+
+// System headers
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+// Local headers
+#include "mesh.hpp"
+#include "gloom/frustum.hpp"
+
+
+// Axis aligned bounding box. An empty box has min > max.
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    AABB() : min(1e30f), max(-1e30f) { }
+    AABB(glm::vec3 min, glm::vec3 max) : min(min), max(max) { }
+};
+
+// Result of testing a box against a frustum
+enum FrustumTest {
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE
+};
+
+
+// Bounding box helpers
+bool isEmpty(const AABB& box);
+AABB mergeAABB(const AABB& a, const AABB& b);
+AABB growAABB(const AABB& box, glm::vec3 point);
+glm::vec3 centerOf(const AABB& box);
+float surfaceArea(const AABB& box);
+bool overlaps(const AABB& a, const AABB& b);
+
+// Bounding box of a box transformed by a matrix, computed from the matrix columns rather than all eight corners
+AABB transformAABB(const AABB& box, const glm::mat4& matrix);
+
+// Bounding box of the vertices of a mesh
+AABB computeMeshBounds(const Mesh& mesh);
+
+// Returns false if the box lies completely outside one of the frustum planes
+bool intersectsFrustum(const Gloom::Frustum& frustum, const AABB& box);
+
+// Tells whether a box is outside the frustum, partly inside or completely inside, so that the contents of
+// a box completely inside need no further tests. Empty boxes are outside.
+FrustumTest classifyAgainstFrustum(const Gloom::Frustum& frustum, const AABB& box);
+
+
+#endif
@@ -0,0 +1,593 @@
+#include "bvh.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+// Number of bins the centroids are sorted into when searching for a split
+#define BVH_BIN_COUNT 16
+
+// Leaves are split until they hold at most this many primitives, or splitting no longer pays off
+#define BVH_MAX_LEAF_SIZE 4
+
+// Cost of visiting an inner node relative to testing a primitive
+#define BVH_TRAVERSAL_COST 1.0f
+
+// The tree is rebuilt once refitting has made it this much more expensive than when it was built
+#define BVH_REBUILD_THRESHOLD 1.5f
+
+// Number of updates between evaluating the cost of the refitted tree
+#define BVH_QUALITY_CHECK_INTERVAL 30
+
+// Parent of the root
+#define BVH_NO_PARENT 0xFFFFFFFFu
+
+// Below this depth nodes are split at the median rather than by the SAH, so skewed scenes cannot make the tree
+// arbitrarily deep. Median splits halve the primitives, adding at most 32 more levels for 32-bit counts.
+#define BVH_MAX_SAH_DEPTH 32
+
+// Deepest traversal stack a query needs: one pending sibling per level, and both children of the deepest node
+#define BVH_STACK_SIZE (BVH_MAX_SAH_DEPTH + 32 + 2)
+
+
+static inline bool same_bounds(const AABB& a, const AABB& b) {
+    return a.min == b.min && a.max == b.max;
+}
+
+/* Slab test. Returns the distance at which the ray enters the box, or a negative value if it misses */
+static inline float ray_enters(const AABB& box, glm::vec3 origin, glm::vec3 inverseDirection, float maxDistance) {
+    if (isEmpty(box)) {
+        return -1.0f;
+    }
+    glm::vec3 t0 = (box.min - origin) * inverseDirection;
+    glm::vec3 t1 = (box.max - origin) * inverseDirection;
+    glm::vec3 near = glm::min(t0, t1);
+    glm::vec3 far = glm::max(t0, t1);
+
+    float entry = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+    float exit = std::min(std::min(far.x, far.y), std::min(far.z, maxDistance));
+    return (entry <= exit) ? entry : -1.0f;
+}
+
+static inline bool sphere_overlaps(const AABB& box, glm::vec3 center, float radius) {
+    glm::vec3 closest = glm::clamp(center, box.min, box.max);
+    glm::vec3 offset = closest - center;
+    return glm::dot(offset, offset) <= radius * radius;
+}
+
+
+BVH::BVH()
+    : sceneRoot(nullptr), structureVersion(0), updatesSinceQualityCheck(0), rebuilds(0), rebuilding(false) {
+    tree.buildCost = 0.0f;
+    tree.depth = 0;
+}
+
+BVH::~BVH() {
+    // The background build only touches its own copies, but must not outlive them
+    if (rebuilding) {
+        pendingTree.wait();
+    }
+}
+
+/* Binned SAH build. Runs on a background thread during rebuilds, so it only reads the bounds it is given */
+BVH::Tree BVH::buildTree(const std::vector<AABB>& bounds) {
+    Tree result;
+    result.buildCost = 0.0f;
+    result.depth = 0;
+    unsigned int primitive_count = (unsigned int)bounds.size();
+    if (primitive_count == 0) {
+        return result;
+    }
+
+    result.order.resize(primitive_count);
+    result.leafOfPrimitive.resize(primitive_count);
+    std::vector<glm::vec3> centroids(primitive_count);
+    for (unsigned int i = 0; i < primitive_count; i++) {
+        result.order[i] = i;
+        centroids[i] = centerOf(bounds[i]);
+    }
+
+    Node root;
+    root.first = 0;
+    root.count = primitive_count;
+    result.nodes.reserve(2 * primitive_count - 1);
+    result.nodes.push_back(root);
+    result.parents.push_back(BVH_NO_PARENT);
+
+    // Nodes still to be built, with their depth below the root
+    std::vector<std::pair<unsigned int, unsigned int>> work;
+    work.push_back(std::make_pair(0u, 0u));
+
+    while (!work.empty()) {
+        unsigned int node_index = work.back().first;
+        unsigned int node_depth = work.back().second;
+        work.pop_back();
+        result.depth = std::max(result.depth, node_depth);
+
+        unsigned int first = result.nodes[node_index].first;
+        unsigned int count = result.nodes[node_index].count;
+
+        AABB node_bounds;
+        AABB centroid_bounds;
+        for (unsigned int i = first; i < first + count; i++) {
+            node_bounds = mergeAABB(node_bounds, bounds[result.order[i]]);
+            centroid_bounds = growAABB(centroid_bounds, centroids[result.order[i]]);
+        }
+        result.nodes[node_index].bounds = node_bounds;
+
+        // Find the cheapest bin boundary over all three axes
+        float best_cost = 1e30f;
+        int best_axis = -1;
+        int best_split = 0;
+
+        bool use_sah = node_depth < BVH_MAX_SAH_DEPTH;
+        for (int axis = 0; axis < 3 && count > 1 && use_sah; axis++) {
+            float low = centroid_bounds.min[axis];
+            float extent = centroid_bounds.max[axis] - low;
+            float scale = BVH_BIN_COUNT / extent;
+
+            // Also skips extents so small that the scale overflows, which would give bins out of range
+            if (extent <= 0.0f || !std::isfinite(scale)) {
+                continue;
+            }
+
+            AABB bin_bounds[BVH_BIN_COUNT];
+            unsigned int bin_counts[BVH_BIN_COUNT] = { 0 };
+            for (unsigned int i = first; i < first + count; i++) {
+                unsigned int primitive = result.order[i];
+                int bin = std::min((int)((centroids[primitive][axis] - low) * scale), BVH_BIN_COUNT - 1);
+                bin_counts[bin]++;
+                bin_bounds[bin] = mergeAABB(bin_bounds[bin], bounds[primitive]);
+            }
+
+            // Sweep from the right to get the cost of everything right of each boundary, then from the left
+            float right_costs[BVH_BIN_COUNT];
+            AABB right_bounds;
+            unsigned int right_count = 0;
+            for (int bin = BVH_BIN_COUNT - 1; bin > 0; bin--) {
+                right_bounds = mergeAABB(right_bounds, bin_bounds[bin]);
+                right_count += bin_counts[bin];
+                right_costs[bin] = right_count * surfaceArea(right_bounds);
+            }
+
+            AABB left_bounds;
+            unsigned int left_count = 0;
+            for (int split = 1; split < BVH_BIN_COUNT; split++) {
+                left_bounds = mergeAABB(left_bounds, bin_bounds[split - 1]);
+                left_count += bin_counts[split - 1];
+                if (left_count == 0 || left_count == count) {
+                    continue;
+                }
+
+                float split_cost = left_count * surfaceArea(left_bounds) + right_costs[split];
+                if (split_cost < best_cost) {
+                    best_cost = split_cost;
+                    best_axis = axis;
+                    best_split = split;
+                }
+            }
+        }
+
+        float area = surfaceArea(node_bounds);
+        float leaf_cost = count * area;
+        float split_cost = BVH_TRAVERSAL_COST * area + best_cost;
+
+        if (count <= BVH_MAX_LEAF_SIZE && (!use_sah || best_axis < 0 || split_cost >= leaf_cost)) {
+            for (unsigned int i = first; i < first + count; i++) {
+                result.leafOfPrimitive[result.order[i]] = node_index;
+            }
+            continue;
+        }
+
+        // Partition the primitives by the chosen boundary, past the SAH depth at the median along the widest axis,
+        // or in half if all centroids coincide
+        unsigned int middle;
+        if (!use_sah) {
+            glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+            int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z) ? 1 : 2;
+
+            unsigned int* begin = &result.order[0] + first;
+            std::nth_element(begin, begin + count / 2, begin + count, [&](unsigned int a, unsigned int b) {
+                return centroids[a][axis] < centroids[b][axis];
+            });
+            middle = first + count / 2;
+        } else if (best_axis >= 0) {
+            float low = centroid_bounds.min[best_axis];
+            float scale = BVH_BIN_COUNT / (centroid_bounds.max[best_axis] - low);
+
+            unsigned int* begin = &result.order[0] + first;
+            unsigned int* split = std::partition(begin, begin + count, [&](unsigned int primitive) {
+                int bin = std::min((int)((centroids[primitive][best_axis] - low) * scale), BVH_BIN_COUNT - 1);
+                return bin < best_split;
+            });
+            middle = first + (unsigned int)(split - begin);
+        } else {
+            middle = first + count / 2;
+        }
+
+        Node left;
+        left.first = first;
+        left.count = middle - first;
+        Node right;
+        right.first = middle;
+        right.count = first + count - middle;
+
+        unsigned int left_index = (unsigned int)result.nodes.size();
+        result.nodes.push_back(left);
+        result.nodes.push_back(right);
+        result.parents.push_back(node_index);
+        result.parents.push_back(node_index);
+
+        result.nodes[node_index].first = left_index;
+        result.nodes[node_index].count = 0;
+
+        work.push_back(std::make_pair(left_index + 1, node_depth + 1));
+        work.push_back(std::make_pair(left_index, node_depth + 1));
+    }
+
+    // Every query's traversal stack holds the pending siblings along one path
+    assert(result.depth + 2 <= BVH_STACK_SIZE);
+
+    result.buildCost = treeCost(result);
+    return result;
+}
+
+/* Expected cost of a random query: every node weighted by the probability of entering it, relative to the root */
+float BVH::treeCost(const Tree& tree) {
+    if (tree.nodes.empty()) {
+        return 0.0f;
+    }
+    float root_area = surfaceArea(tree.nodes[0].bounds);
+    if (root_area <= 0.0f) {
+        return 0.0f;
+    }
+
+    float total = 0.0f;
+    for (const Node& node : tree.nodes) {
+        float weight = (node.count > 0) ? (float)node.count : BVH_TRAVERSAL_COST;
+        total += weight * surfaceArea(node.bounds);
+    }
+    return total / root_area;
+}
+
+float BVH::cost() const {
+    return treeCost(tree);
+}
+
+/* Gathers every node below the scene root that has geometry */
+void BVH::collectPrimitives(Primitives& result) const {
+    result.handles.clear();
+    result.nodes.clear();
+    result.versions.clear();
+    result.bounds.clear();
+
+    if (sceneRoot == nullptr) {
+        return;
+    }
+
+    std::vector<SceneNode*> stack;
+    stack.push_back(sceneRoot);
+
+    while (!stack.empty()) {
+        SceneNode* node = stack.back();
+        stack.pop_back();
+
+        if (!isEmpty(node->localBounds)) {
+            result.handles.push_back(getSceneNodeHandle(node));
+            result.nodes.push_back(node);
+            result.versions.push_back(node->transformVersion);
+            result.bounds.push_back(node->worldBounds);
+        }
+
+        for (SceneNode* child : node->children) {
+            stack.push_back(child);
+        }
+    }
+}
+
+void BVH::build(SceneNode* root) {
+    PROFILE_ZONE("BVH build");
+    if (rebuilding) {
+        pendingTree.wait();
+        rebuilding = false;
+    }
+
+    sceneRoot = root;
+    structureVersion = getSceneStructureVersion();
+    updatesSinceQualityCheck = 0;
+
+    collectPrimitives(primitives);
+    tree = buildTree(primitives.bounds);
+}
+
+void BVH::startRebuild(const Primitives& snapshot) {
+    pendingPrimitives = snapshot;
+
+    // The build task gets its own copy of the boxes, so refits can keep changing ours
+    std::vector<AABB> bounds = pendingPrimitives.bounds;
+    pendingTree = std::async(std::launch::async, [bounds]() {
+        return buildTree(bounds);
+    });
+    rebuilding = true;
+}
+
+void BVH::finishRebuild() {
+    primitives = std::move(pendingPrimitives);
+    tree = pendingTree.get();
+    rebuilding = false;
+    rebuilds++;
+
+    // Nodes kept moving while the tree was being built, so pick up their current boxes.
+    // The build cost stays that of the fresh tree, so later quality checks compare against the best case.
+    refitAll();
+}
+
+/* Recomputes a leaf box from its primitives and walks up, stopping at the first ancestor whose box did not change */
+void BVH::refitLeaf(unsigned int leaf) {
+    Node& leaf_node = tree.nodes[leaf];
+    AABB box;
+    for (unsigned int i = leaf_node.first; i < leaf_node.first + leaf_node.count; i++) {
+        box = mergeAABB(box, primitives.bounds[tree.order[i]]);
+    }
+    if (same_bounds(box, leaf_node.bounds)) {
+        return;
+    }
+    leaf_node.bounds = box;
+
+    unsigned int parent = tree.parents[leaf];
+    while (parent != BVH_NO_PARENT) {
+        Node& node = tree.nodes[parent];
+        AABB merged = mergeAABB(tree.nodes[node.first].bounds, tree.nodes[node.first + 1].bounds);
+        if (same_bounds(merged, node.bounds)) {
+            return;
+        }
+        node.bounds = merged;
+        parent = tree.parents[parent];
+    }
+}
+
+/* Refreshes every primitive and refits the whole tree bottom up. Children always come after their parent. */
+void BVH::refitAll() {
+    for (size_t i = 0; i < primitives.handles.size(); i++) {
+        SceneNode* node = resolveSceneNode(primitives.handles[i]);
+        primitives.bounds[i] = (node != nullptr) ? node->worldBounds : AABB();
+        primitives.versions[i] = (node != nullptr) ? node->transformVersion : 0;
+    }
+
+    for (size_t index = tree.nodes.size(); index-- > 0;) {
+        Node& node = tree.nodes[index];
+        AABB box;
+        if (node.count > 0) {
+            for (unsigned int i = node.first; i < node.first + node.count; i++) {
+                box = mergeAABB(box, primitives.bounds[tree.order[i]]);
+            }
+        } else {
+            box = mergeAABB(tree.nodes[node.first].bounds, tree.nodes[node.first + 1].bounds);
+        }
+        node.bounds = box;
+    }
+}
+
+void BVH::update() {
+    PROFILE_ZONE("BVH update");
+    if (sceneRoot == nullptr) {
+        return;
+    }
+
+    // Swap in a finished background build
+    if (rebuilding && pendingTree.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        finishRebuild();
+    }
+
+    // Refit the leaves of nodes that moved. Destroyed nodes keep an empty box until the next rebuild.
+    for (size_t i = 0; i < primitives.handles.size(); i++) {
+        SceneNode* node = resolveSceneNode(primitives.handles[i]);
+        if (node == nullptr) {
+            if (!isEmpty(primitives.bounds[i])) {
+                primitives.bounds[i] = AABB();
+                refitLeaf(tree.leafOfPrimitive[i]);
+            }
+            continue;
+        }
+        if (node->transformVersion != primitives.versions[i]) {
+            primitives.versions[i] = node->transformVersion;
+            primitives.bounds[i] = node->worldBounds;
+            refitLeaf(tree.leafOfPrimitive[i]);
+        }
+    }
+
+    if (rebuilding) {
+        return;
+    }
+
+    // Nodes were added or removed: rebuild over the new set of nodes
+    if (getSceneStructureVersion() != structureVersion) {
+        structureVersion = getSceneStructureVersion();
+        updatesSinceQualityCheck = 0;
+
+        Primitives snapshot;
+        collectPrimitives(snapshot);
+        startRebuild(snapshot);
+        return;
+    }
+
+    // Refitting keeps the tree valid, but boxes of nodes that moved apart grow and overlap
+    if (++updatesSinceQualityCheck >= BVH_QUALITY_CHECK_INTERVAL) {
+        updatesSinceQualityCheck = 0;
+        if (cost() > BVH_REBUILD_THRESHOLD * tree.buildCost) {
+            startRebuild(primitives);
+        }
+    }
+}
+
+
+void BVH::queryAABB(const AABB& box, std::vector<SceneNode*>& results) const {
+    if (tree.nodes.empty()) {
+        return;
+    }
+    unsigned int stack[BVH_STACK_SIZE];
+    unsigned int depth = 0;
+    stack[depth++] = 0;
+
+    while (depth > 0) {
+        const Node& node = tree.nodes[stack[--depth]];
+        if (!overlaps(node.bounds, box)) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (unsigned int i = node.first; i < node.first + node.count; i++) {
+                unsigned int primitive = tree.order[i];
+                if (overlaps(primitives.bounds[primitive], box)) {
+                    results.push_back(primitives.nodes[primitive]);
+                }
+            }
+        } else {
+            assert(depth + 2 <= BVH_STACK_SIZE);
+            stack[depth++] = node.first + 1;
+            stack[depth++] = node.first;
+        }
+    }
+}
+
+void BVH::querySphere(glm::vec3 center, float radius, std::vector<SceneNode*>& results) const {
+    if (tree.nodes.empty()) {
+        return;
+    }
+    unsigned int stack[BVH_STACK_SIZE];
+    unsigned int depth = 0;
+    stack[depth++] = 0;
+
+    while (depth > 0) {
+        const Node& node = tree.nodes[stack[--depth]];
+        if (isEmpty(node.bounds) || !sphere_overlaps(node.bounds, center, radius)) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (unsigned int i = node.first; i < node.first + node.count; i++) {
+                unsigned int primitive = tree.order[i];
+                const AABB& bounds = primitives.bounds[primitive];
+                if (!isEmpty(bounds) && sphere_overlaps(bounds, center, radius)) {
+                    results.push_back(primitives.nodes[primitive]);
+                }
+            }
+        } else {
+            assert(depth + 2 <= BVH_STACK_SIZE);
+            stack[depth++] = node.first + 1;
+            stack[depth++] = node.first;
+        }
+    }
+}
+
+void BVH::queryFrustum(const Gloom::Frustum& frustum, std::vector<SceneNode*>& results) const {
+    if (tree.nodes.empty()) {
+        return;
+    }
+    unsigned int stack[BVH_STACK_SIZE];
+    unsigned int depth = 0;
+    stack[depth++] = 0;
+
+    while (depth > 0) {
+        const Node& node = tree.nodes[stack[--depth]];
+        if (isEmpty(node.bounds) || !intersectsFrustum(frustum, node.bounds)) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (unsigned int i = node.first; i < node.first + node.count; i++) {
+                unsigned int primitive = tree.order[i];
+                const AABB& bounds = primitives.bounds[primitive];
+                if (!isEmpty(bounds) && intersectsFrustum(frustum, bounds)) {
+                    results.push_back(primitives.nodes[primitive]);
+                }
+            }
+        } else {
+            assert(depth + 2 <= BVH_STACK_SIZE);
+            stack[depth++] = node.first + 1;
+            stack[depth++] = node.first;
+        }
+    }
+}
+
+void BVH::queryRay(glm::vec3 origin, glm::vec3 direction, float maxDistance, std::vector<SceneNode*>& results) const {
+    if (tree.nodes.empty()) {
+        return;
+    }
+    glm::vec3 inverse_direction = 1.0f / direction;
+    unsigned int stack[BVH_STACK_SIZE];
+    unsigned int depth = 0;
+    stack[depth++] = 0;
+
+    while (depth > 0) {
+        const Node& node = tree.nodes[stack[--depth]];
+        if (ray_enters(node.bounds, origin, inverse_direction, maxDistance) < 0.0f) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (unsigned int i = node.first; i < node.first + node.count; i++) {
+                unsigned int primitive = tree.order[i];
+                if (ray_enters(primitives.bounds[primitive], origin, inverse_direction, maxDistance) >= 0.0f) {
+                    results.push_back(primitives.nodes[primitive]);
+                }
+            }
+        } else {
+            assert(depth + 2 <= BVH_STACK_SIZE);
+            stack[depth++] = node.first + 1;
+            stack[depth++] = node.first;
+        }
+    }
+}
+
+SceneNode* BVH::raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, float* hitDistance) const {
+    if (tree.nodes.empty()) {
+        return nullptr;
+    }
+    glm::vec3 inverse_direction = 1.0f / direction;
+    SceneNode* closest = nullptr;
+    float closest_distance = maxDistance;
+
+    unsigned int stack[BVH_STACK_SIZE];
+    unsigned int depth = 0;
+    stack[depth++] = 0;
+
+    while (depth > 0) {
+        const Node& node = tree.nodes[stack[--depth]];
+        if (ray_enters(node.bounds, origin, inverse_direction, closest_distance) < 0.0f) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (unsigned int i = node.first; i < node.first + node.count; i++) {
+                unsigned int primitive = tree.order[i];
+                float distance = ray_enters(primitives.bounds[primitive], origin, inverse_direction, closest_distance);
+                if (distance >= 0.0f && distance < closest_distance) {
+                    closest_distance = distance;
+                    closest = primitives.nodes[primitive];
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first, so the far one is often skipped once a hit shortens the ray
+        unsigned int near_child = node.first;
+        unsigned int far_child = node.first + 1;
+        float near_distance = ray_enters(tree.nodes[near_child].bounds, origin, inverse_direction, closest_distance);
+        float far_distance = ray_enters(tree.nodes[far_child].bounds, origin, inverse_direction, closest_distance);
+        if (far_distance >= 0.0f && (near_distance < 0.0f || far_distance < near_distance)) {
+            std::swap(near_child, far_child);
+            std::swap(near_distance, far_distance);
+        }
+        assert(depth + 2 <= BVH_STACK_SIZE);
+        if (far_distance >= 0.0f) {
+            stack[depth++] = far_child;
+        }
+        if (near_distance >= 0.0f) {
+            stack[depth++] = near_child;
+        }
+    }
+
+    if (closest != nullptr && hitDistance != nullptr) {
+        *hitDistance = closest_distance;
+    }
+    return closest;
+}
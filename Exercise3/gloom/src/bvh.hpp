@@ -0,0 +1,106 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+#pragma once
+
+
+// System headers
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <future>
+#include <vector>
+
+// Local headers
+#include "bounds.hpp"
+#include "sceneGraph.hpp"
+
+
+// Bounding volume hierarchy over the world bounds of the scene nodes that have a mesh.
+// The tree is built with a binned surface area heuristic, falling back to median splits past a maximum depth
+// so that the traversal stacks of the queries stay bounded. Every frame, update() refits only the boxes
+// above nodes whose transformVersion changed. When the refitted tree has become too expensive compared
+// to a fresh build, or nodes were added or removed, a new tree is built on a background thread
+// and swapped in once it is done. Queries keep using the current tree in the meantime.
+class BVH {
+public:
+    BVH();
+    ~BVH();
+
+    // Builds the tree over the subtree rooted at root, blocking until it is done
+    void build(SceneNode* root);
+
+    // Picks up transform changes since the last call. Call after the scene nodes have been updated.
+    void update();
+
+    // Queries append the nodes whose world bounds pass the test to results
+    void queryAABB(const AABB& box, std::vector<SceneNode*>& results) const;
+    void querySphere(glm::vec3 center, float radius, std::vector<SceneNode*>& results) const;
+    void queryFrustum(const Gloom::Frustum& frustum, std::vector<SceneNode*>& results) const;
+    void queryRay(glm::vec3 origin, glm::vec3 direction, float maxDistance, std::vector<SceneNode*>& results) const;
+
+    // Returns the node whose world bounds the ray enters first, or nullptr, and the distance to that box
+    SceneNode* raycast(glm::vec3 origin, glm::vec3 direction, float maxDistance, float* hitDistance = nullptr) const;
+
+    // Statistics
+    size_t primitiveCount() const { return primitives.handles.size(); }
+    size_t nodeCount() const { return tree.nodes.size(); }
+    unsigned int depth() const { return tree.depth; }
+    float cost() const;
+    float buildCost() const { return tree.buildCost; }
+    unsigned int rebuildCount() const { return rebuilds; }
+    bool isRebuilding() const { return rebuilding; }
+
+private:
+    BVH(BVH const &) = delete;
+    BVH & operator =(BVH const &) = delete;
+
+    // A leaf (count > 0) holds primitives [first, first + count) of the tree's order,
+    // an inner node (count == 0) has its children at first and first + 1
+    struct Node {
+        AABB bounds;
+        unsigned int first;
+        unsigned int count;
+    };
+
+    struct Tree {
+        std::vector<Node> nodes;
+        std::vector<unsigned int> parents;
+        std::vector<unsigned int> order;
+        std::vector<unsigned int> leafOfPrimitive;
+        float buildCost;
+        unsigned int depth;
+    };
+
+    // The scene nodes the tree is built over, with their world bounds and the transformVersion they were taken at
+    struct Primitives {
+        std::vector<SceneNodeHandle> handles;
+        std::vector<SceneNode*> nodes;
+        std::vector<unsigned long> versions;
+        std::vector<AABB> bounds;
+    };
+
+    static Tree buildTree(const std::vector<AABB>& bounds);
+    static float treeCost(const Tree& tree);
+
+    void collectPrimitives(Primitives& result) const;
+    void startRebuild(const Primitives& snapshot);
+    void finishRebuild();
+    void refitLeaf(unsigned int leaf);
+    void refitAll();
+
+    SceneNode* sceneRoot;
+    unsigned long structureVersion;
+    unsigned int updatesSinceQualityCheck;
+    unsigned int rebuilds;
+
+    Primitives primitives;
+    Tree tree;
+
+    // Background rebuild in progress, and the primitives it is being built over
+    bool rebuilding;
+    Primitives pendingPrimitives;
+    std::future<Tree> pendingTree;
+};
+
+
+#endif
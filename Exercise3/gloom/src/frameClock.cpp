@@ -0,0 +1,53 @@
+#include "frameClock.hpp"
+
+#include <cmath>
+
+// Ticks run in one frame at most, unless changed with setMaxTicksPerFrame()
+#define DEFAULT_MAX_TICKS_PER_FRAME 8
+
+
+FrameClock::FrameClock(double ticksPerSecond)
+    : previousTimePoint(std::chrono::steady_clock::now()),
+      tickLength(1.0 / ticksPerSecond), scaleFactor(1.0), maxTicks(DEFAULT_MAX_TICKS_PER_FRAME),
+      accumulator(0.0), simulationSeconds(0.0), frameLength(0.0), elapsed(0.0), dropped(0.0), frameTicks(0) {
+}
+
+void FrameClock::beginFrame() {
+    std::chrono::steady_clock::time_point current_time = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(current_time - previousTimePoint).count();
+    previousTimePoint = current_time;
+
+    beginFrame(seconds);
+}
+
+void FrameClock::beginFrame(double seconds) {
+    frameLength = seconds;
+    elapsed += seconds;
+    frameTicks = 0;
+
+    accumulator += seconds * scaleFactor;
+
+    double limit = maxTicks * tickLength;
+    if (accumulator >= limit + tickLength) {
+        // Keep the fraction of a tick, so interpolation carries on smoothly after the dropped time
+        double excess = accumulator - limit;
+        double kept = std::fmod(excess, tickLength);
+        dropped += excess - kept;
+        accumulator = limit + kept;
+    }
+}
+
+bool FrameClock::tick() {
+    if (accumulator < tickLength) {
+        return false;
+    }
+    accumulator -= tickLength;
+    simulationSeconds += tickLength;
+    frameTicks++;
+    return true;
+}
+
+/* The time already accumulated is kept, the ticks it is spent on just get shorter or longer */
+void FrameClock::setTickRate(double ticksPerSecond) {
+    tickLength = 1.0 / ticksPerSecond;
+}
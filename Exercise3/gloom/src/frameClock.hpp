@@ -0,0 +1,71 @@
+#ifndef FRAME_CLOCK_HPP
+#define FRAME_CLOCK_HPP
+#pragma once
+
+
+// System headers
+#include <chrono>
+
+
+// Turns the real time between rendered frames into fixed length simulation ticks.
+// Every frame adds its (scaled) duration to an accumulator, and tick() consumes it one tick at a time, so the
+// simulation advances by the same steps whatever the frame rate. What is left over is less than one tick and
+// gives interpolation(), the fraction of the way from the previous to the latest tick that the frame shows.
+class FrameClock {
+public:
+    explicit FrameClock(double ticksPerSecond = 60.0);
+
+    // Starts a frame lasting the real time since the previous frame (or since the clock was created)
+    void beginFrame();
+
+    // Starts a frame lasting the given number of seconds, whatever the real time, e.g. to replay a run at a fixed rate
+    void beginFrame(double seconds);
+
+    // Returns true and advances the simulation time by one tick while a tick is due in this frame
+    bool tick();
+
+    // Fraction in [0, 1) of a tick the frame lies beyond the previous tick. The frame shows the state of the
+    // previous tick interpolated towards the latest one by this, so what is displayed lags one tick behind.
+    double interpolation() const { return accumulator / tickLength; }
+
+    // Real seconds of the current frame, not affected by the time scale, for input such as camera movement
+    double frameSeconds() const { return frameLength; }
+
+    // Real seconds since the clock was created, summed over all frames
+    double elapsedSeconds() const { return elapsed; }
+
+    // Time of the latest tick and the length of a tick, in simulation seconds
+    double simulationTime() const { return simulationSeconds; }
+    double tickSeconds() const { return tickLength; }
+
+    void setTickRate(double ticksPerSecond);
+
+    // Simulation seconds per real second: 0 pauses the simulation, 0.5 runs it at half speed
+    void setTimeScale(double scale) { scaleFactor = (scale > 0.0) ? scale : 0.0; }
+    double timeScale() const { return scaleFactor; }
+
+    // At most this many ticks are run in one frame. If a frame took longer (a breakpoint, the window being dragged),
+    // the rest of the time is dropped, so the simulation slows down instead of falling further and further behind.
+    void setMaxTicksPerFrame(unsigned int ticks) { maxTicks = (ticks > 0) ? ticks : 1; }
+
+    // Ticks run in the current frame so far, and simulation seconds dropped by the catch-up limit since the start
+    unsigned int ticksThisFrame() const { return frameTicks; }
+    double droppedSeconds() const { return dropped; }
+
+private:
+    std::chrono::steady_clock::time_point previousTimePoint;
+
+    double tickLength;
+    double scaleFactor;
+    unsigned int maxTicks;
+
+    double accumulator;
+    double simulationSeconds;
+    double frameLength;
+    double elapsed;
+    double dropped;
+    unsigned int frameTicks;
+};
+
+
+#endif
@@ -9,9 +9,18 @@
 #include <glm/gtc/quaternion.hpp>
 #include <GLFW/glfw3.h>
 
+// Local headers
+#include "frustum.hpp"
+
 
 namespace Gloom
 {
+    /* Owns the view and projection of a camera and everything derived
+       from them: the view projection, its inverse and the frustum planes.
+       They are recomputed when first asked for after the position, the
+       orientation or the projection has changed, and each recomputation
+       increments the version, so that results computed for one version
+       (culling, sorting, level of detail) can be kept until it changes. */
     class Camera
     {
     public:
@@ -23,14 +32,63 @@ namespace Gloom
             cMovementSpeed    = movementSpeed;
             cMouseSensitivity = mouseSensitivity;
 
-            // Set up the initial view matrix
-            updateViewMatrix();
+            // Looking down -z. The matrices are computed when first asked for.
+            cQuaternion   = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+            matProjection = glm::mat4(1.0f);
+            cDirty        = true;
+            cVersion      = 0;
         }
 
         // Public member functions
 
-        /* Getter for the view matrix */
-        glm::mat4 getViewMatrix() { return matView; }
+        /* Getters for the matrices and frustum, recomputed if needed */
+        glm::mat4 getViewMatrix()                  { refresh(); return matView; }
+        glm::mat4 getProjectionMatrix()            { return matProjection; }
+        glm::mat4 getViewProjectionMatrix()        { refresh(); return matViewProjection; }
+        glm::mat4 getInverseViewProjectionMatrix() { refresh(); return matInverseViewProjection; }
+        Frustum const & getFrustum()               { refresh(); return cFrustum; }
+        glm::vec3 getPosition()                    { return cPosition; }
+
+        /* Incremented every time the matrices are recomputed */
+        unsigned int getVersion()                  { refresh(); return cVersion; }
+
+
+        /* Sets a perspective projection, as glm::perspective */
+        void setProjection(GLfloat fieldOfView, GLfloat aspectRatio,
+                           GLfloat nearPlane, GLfloat farPlane)
+        {
+            glm::mat4 projection = glm::perspective(fieldOfView, aspectRatio, nearPlane, farPlane);
+            if (projection != matProjection)
+            {
+                matProjection = projection;
+                cDirty = true;
+            }
+        }
+
+
+        /* Moves the camera to a position in world coordinates */
+        void setPosition(glm::vec3 position)
+        {
+            if (position != cPosition)
+            {
+                cPosition = position;
+                cDirty = true;
+            }
+        }
+
+
+        /* Turns the camera to yaw radians about the y axis followed by
+           pitch radians about the x axis, both from looking down -z */
+        void setOrientation(GLfloat pitch, GLfloat yaw)
+        {
+            glm::quat orientation = glm::quat(glm::vec3(pitch, 0.0f, 0.0f))
+                                  * glm::quat(glm::vec3(0.0f, yaw, 0.0f));
+            if (orientation != cQuaternion)
+            {
+                cQuaternion = orientation;
+                cDirty = true;
+            }
+        }
 
 
         /* Handle keyboard inputs from a callback mechanism */
@@ -93,11 +151,17 @@ namespace Gloom
         }
 
 
-        /* Update the camera position and view matrix
-           `deltaTime` is the time between the current and last frame */
+        /* Update the camera position and orientation from the inputs.
+           `deltaTime` is the time between the current and last frame.
+           Nothing is recomputed unless a key is held or the mouse moved. */
         void updateCamera(GLfloat deltaTime)
         {
+            // Apply the mouse movement since the last update
+            if (fPitch != 0.0f || fYaw != 0.0f)
+                updateOrientation();
+
             // Extract movement information from the view matrix
+            refresh();
             glm::vec3 dirX(matView[0][0], matView[1][0], matView[2][0]);
             glm::vec3 dirY(matView[0][1], matView[1][1], matView[2][1]);
             glm::vec3 dirZ(matView[0][2], matView[1][2], matView[2][2]);
@@ -127,10 +191,11 @@ namespace Gloom
             GLfloat velocity = cMovementSpeed * deltaTime;
 
             // Update camera position using the appropriate velocity
-            cPosition += fMovement * velocity;
-
-            // Update the view matrix based on the new information
-            updateViewMatrix();
+            if (fMovement != glm::vec3(0.0f, 0.0f, 0.0f))
+            {
+                cPosition += fMovement * velocity;
+                cDirty = true;
+            }
         }
 
     private:
@@ -140,8 +205,8 @@ namespace Gloom
 
         // Private member function
 
-        /* Update the view matrix based on the current information */
-        void updateViewMatrix()
+        /* Turn the camera by the pitch and yaw of the mouse movement */
+        void updateOrientation()
         {
             // Adjust cursor movement using the specified sensitivity
             fPitch *= cMouseSensitivity;
@@ -158,6 +223,15 @@ namespace Gloom
             // Update camera quaternion and normalise
             cQuaternion = qYaw * qPitch * cQuaternion;
             cQuaternion = glm::normalize(cQuaternion);
+            cDirty = true;
+        }
+
+
+        /* Recompute the matrices and frustum if anything has changed */
+        void refresh()
+        {
+            if (!cDirty)
+                return;
 
             // Build rotation matrix using the camera quaternion
             glm::mat4 matRotation = glm::mat4_cast(cQuaternion);
@@ -165,8 +239,14 @@ namespace Gloom
             // Build translation matrix
             glm::mat4 matTranslate = glm::translate(glm::mat4(1.0f), -cPosition);
 
-            // Update view matrix
+            // Update view matrix and everything derived from it
             matView = matRotation * matTranslate;
+            matViewProjection = matProjection * matView;
+            matInverseViewProjection = glm::inverse(matViewProjection);
+            cFrustum = extractFrustum(matViewProjection);
+
+            cDirty = false;
+            cVersion++;
         }
 
         // Private member variables
@@ -192,8 +272,16 @@ namespace Gloom
         GLfloat cMovementSpeed;
         GLfloat cMouseSensitivity;
 
-        // View matrix
+        // View and projection matrices and everything derived from them
         glm::mat4 matView;
+        glm::mat4 matProjection;
+        glm::mat4 matViewProjection;
+        glm::mat4 matInverseViewProjection;
+        Frustum cFrustum;
+
+        // Whether the matrices are out of date, and how often they were recomputed
+        bool cDirty;
+        unsigned int cVersion;
     };
 }
 
@@ -0,0 +1,67 @@
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+#pragma once
+
+// System headers
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+
+namespace Gloom
+{
+    /* The six planes of a view frustum as (normal, distance), normals
+       pointing inwards. A point p is inside a plane when
+       dot(normal, p) + distance >= 0. The planes are also stored component
+       by component and padded to eight with planes that contain
+       everything, so that boxes can be tested against four planes at a
+       time. */
+    struct Frustum
+    {
+        glm::vec4 planes[6];
+
+        alignas(16) float planeX[8];
+        alignas(16) float planeY[8];
+        alignas(16) float planeZ[8];
+        alignas(16) float planeW[8];
+    };
+
+
+    /* Extracts the frustum planes from a view projection matrix
+       (Gribb and Hartmann) */
+    inline Frustum extractFrustum(const glm::mat4& viewProjection)
+    {
+        // Rows of the matrix, glm stores columns
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++)
+        {
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i],
+                               viewProjection[2][i], viewProjection[3][i]);
+        }
+
+        Frustum frustum;
+        frustum.planes[0] = row[3] + row[0]; // Left
+        frustum.planes[1] = row[3] - row[0]; // Right
+        frustum.planes[2] = row[3] + row[1]; // Bottom
+        frustum.planes[3] = row[3] - row[1]; // Top
+        frustum.planes[4] = row[3] + row[2]; // Near
+        frustum.planes[5] = row[3] - row[2]; // Far
+
+        for (int i = 0; i < 6; i++)
+        {
+            float length = glm::length(glm::vec3(frustum.planes[i]));
+            frustum.planes[i] = frustum.planes[i] / length;
+        }
+
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec4 plane = (i < 6) ? frustum.planes[i] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            frustum.planeX[i] = plane.x;
+            frustum.planeY[i] = plane.y;
+            frustum.planeZ[i] = plane.z;
+            frustum.planeW[i] = plane.w;
+        }
+        return frustum;
+    }
+}
+
+#endif
@@ -7,26 +7,85 @@
 
 // Standard headers
 #include <cassert>
+#include <cstdint>
+#include <cstdio>
 #include <fstream>
+#include <map>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
+
+// GL_KHR_parallel_shader_compile, which the loader may not know of
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 namespace Gloom
 {
+    /* A set of preprocessor definitions to compile a shader variant with.
+       Kept sorted by name, so sets with the same definitions added in any
+       order give the same text and are the same variant. */
+    class ShaderDefines
+    {
+    public:
+        ShaderDefines & add(std::string const &name, std::string const &value = "1")
+        {
+            mDefines[name] = value;
+            return *this;
+        }
+
+        bool empty() const { return mDefines.empty(); }
+
+        /* The #define lines, one per definition */
+        std::string text() const
+        {
+            std::string lines;
+            for (auto const &define : mDefines)
+                lines += "#define " + define.first + " " + define.second + "\n";
+            return lines;
+        }
+
+    private:
+        std::map<std::string, std::string> mDefines;
+    };
+
+
     class Shader
     {
     public:
-        Shader()            { mProgram = glCreateProgram(); }
+        Shader() : mLinking(false) { mProgram = glCreateProgram(); }
 
         // Public member functions
         void   activate()   { glUseProgram(mProgram); }
         void   deactivate() { glUseProgram(0); }
         GLuint get()        { return mProgram; }
-        void   destroy()    { glDeleteProgram(mProgram); }
 
-        /* Attach a shader to the current shader program */
-        void attach(std::string const &filename)
+        /* Deletes the program, and its shaders if it never finished linking */
+        void destroy()
+        {
+            for (auto const &shader : mCompiling)
+                glDeleteShader(shader.first);
+            mCompiling.clear();
+            mLinking = false;
+            glDeleteProgram(mProgram);
+        }
+
+        /* Attach a shader to the current shader program. The source is
+           read now and compiled by link() or linkAsync(), unless a cached binary of the
+           whole program can be used instead. The defines are inserted
+           after the #version line. */
+        void attach(std::string const &filename,
+                    ShaderDefines const &defines = ShaderDefines())
         {
             // Load GLSL Shader from source
             std::ifstream fd(filename.c_str());
@@ -41,35 +100,93 @@ namespace Gloom
             auto src = std::string(std::istreambuf_iterator<char>(fd),
                                   (std::istreambuf_iterator<char>()));
 
-            // Create shader object
-            const char * source = src.c_str();
-            auto shader = create(filename);
-            glShaderSource(shader, 1, &source, nullptr);
-            glCompileShader(shader);
+            mSources.push_back(Source{ filename, injectDefines(src, defines) });
+        }
 
-            // Display errors
-            glGetShaderiv(shader, GL_COMPILE_STATUS, &mStatus);
-            if (!mStatus)
+
+        /* Links all attached shaders together into a shader program */
+        void link()
+        {
+            linkAsync();
+            finish();
+        }
+
+
+        /* Issues the compile and link commands for all attached shaders
+           without asking for their results, which would make the driver
+           finish them first. Programs submitted one after another then
+           compile at the same time on drivers with compiler threads, and
+           alongside whatever the application does next. isReady() tells
+           when the program can be used; activate() must wait until then. */
+        void linkAsync()
+        {
+            // A cached binary of the same sources from the same driver saves
+            // compiling and linking. Drivers may reject binaries, e.g. after
+            // an update, in which case the sources are compiled as usual.
+            mCacheFile = binaryCacheFile();
+            if (!mCacheFile.empty() && loadBinary(mCacheFile))
             {
-                glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &mLength);
-                std::unique_ptr<char[]> buffer(new char[mLength]);
-                glGetShaderInfoLog(shader, mLength, nullptr, buffer.get());
-                fprintf(stderr, "%s\n%s", filename.c_str(), buffer.get());
+                mSources.clear();
+                return;
             }
 
-            assert(mStatus);
+            for (auto const &source : mSources)
+                compile(source.filename, source.text);
+            mSources.clear();
 
-            // Attach shader and free allocated memory
-            glAttachShader(mProgram, shader);
-            glDeleteShader(shader);
+            // Link all attached shaders
+            if (!mCacheFile.empty())
+                glProgramParameteri(mProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            glLinkProgram(mProgram);
+            mLinking = true;
         }
 
 
-        /* Links all attached shaders together into a shader program */
-        void link()
+        /* Whether a program from linkAsync() has finished linking. Never
+           blocks with GL_KHR_parallel_shader_compile; without it, there
+           is no way to ask, so this waits for the link like finish(). */
+        bool isReady()
         {
-            // Link all attached shaders
-            glLinkProgram(mProgram);
+            if (!mLinking)
+                return true;
+            if (parallelCompileSupported())
+            {
+                GLint complete = GL_FALSE;
+                glGetProgramiv(mProgram, GL_COMPLETION_STATUS_KHR, &complete);
+                if (!complete)
+                    return false;
+            }
+            finish();
+            return true;
+        }
+
+
+        /* Waits for a program from linkAsync() to finish linking, displays
+           any errors and caches its binary */
+        void finish()
+        {
+            if (!mLinking)
+                return;
+            mLinking = false;
+
+            // Compile errors are only asked for now, as asking earlier waits
+            bool compiled = true;
+            for (auto const &shader : mCompiling)
+            {
+                glGetShaderiv(shader.first, GL_COMPILE_STATUS, &mStatus);
+                if (!mStatus)
+                {
+                    glGetShaderiv(shader.first, GL_INFO_LOG_LENGTH, &mLength);
+                    std::unique_ptr<char[]> buffer(new char[mLength]);
+                    glGetShaderInfoLog(shader.first, mLength, nullptr, buffer.get());
+                    fprintf(stderr, "%s\n%s", shader.second.c_str(), buffer.get());
+                    compiled = false;
+                }
+                glDeleteShader(shader.first);
+            }
+            mCompiling.clear();
+
+            assert(compiled);
 
             // Display errors
             glGetProgramiv(mProgram, GL_LINK_STATUS, &mStatus);
@@ -82,16 +199,20 @@ namespace Gloom
             }
 
             assert(mStatus);
+
+            if (mStatus && !mCacheFile.empty())
+                saveBinary(mCacheFile);
         }
 
 
         /* Convenience function that attaches and links a vertex and a
            fragment shader in a shader program */
         void makeBasicShader(std::string const &vertexFilename,
-                             std::string const &fragmentFilename)
+                             std::string const &fragmentFilename,
+                             ShaderDefines const &defines = ShaderDefines())
         {
-            attach(vertexFilename);
-            attach(fragmentFilename);
+            attach(vertexFilename, defines);
+            attach(fragmentFilename, defines);
             link();
         }
 
@@ -116,6 +237,43 @@ namespace Gloom
         }
 
 
+        /* Whether the driver compiles in the background and can be asked
+           if a program is done (GL_KHR_parallel_shader_compile) */
+        static bool parallelCompileSupported()
+        {
+            static int supported = -1;
+            if (supported < 0)
+            {
+                GLint extensions = 0;
+                glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+                supported = 0;
+                for (GLint i = 0; i < extensions; i++)
+                {
+                    std::string name = (const char *) glGetStringi(GL_EXTENSIONS, i);
+                    if (name == "GL_KHR_parallel_shader_compile" || name == "GL_ARB_parallel_shader_compile")
+                        supported = 1;
+                }
+            }
+            return supported == 1;
+        }
+
+
+        /* Directory program binaries are cached in, created if needed.
+           Empty (the default) disables the cache. */
+        static void setBinaryCacheDirectory(std::string const &directory)
+        {
+            binaryCacheDirectory() = directory;
+            if (!directory.empty())
+            {
+#ifdef _WIN32
+                _mkdir(directory.c_str());
+#else
+                mkdir(directory.c_str(), 0755);
+#endif
+            }
+        }
+
+
         /* Helper function for creating shaders */
         GLuint create(std::string const &filename)
         {
@@ -136,10 +294,238 @@ namespace Gloom
         Shader(Shader const &) = delete;
         Shader & operator =(Shader const &) = delete;
 
+        // GLSL source of an attached shader, waiting to be compiled
+        struct Source
+        {
+            std::string filename;
+            std::string text;
+        };
+
+        // Written at the start of cache files, to tell them from anything else
+        static const uint32_t BINARY_CACHE_MAGIC = 0x474c4d42;
+
+        static std::string &binaryCacheDirectory()
+        {
+            static std::string directory;
+            return directory;
+        }
+
+        /* Inserts defines after the #version line, which GLSL requires to
+           come first. A #line directive keeps the line numbers of compile
+           errors those of the file. */
+        static std::string injectDefines(std::string const &source,
+                                         ShaderDefines const &defines)
+        {
+            if (defines.empty())
+                return source;
+
+            size_t version = source.find("#version");
+            size_t insert = (version == std::string::npos) ? 0 : source.find('\n', version);
+            if (insert == std::string::npos)
+                return source + "\n" + defines.text();
+            if (version != std::string::npos)
+                insert++;
+
+            size_t line = 1;
+            for (size_t i = 0; i < insert; i++)
+                if (source[i] == '\n')
+                    line++;
+
+            return source.substr(0, insert) + defines.text()
+                 + "#line " + std::to_string(line) + "\n" + source.substr(insert);
+        }
+
+        /* Starts compiling a shader and attaches it to the program. The
+           shader is kept until finish() has read its compile status. */
+        void compile(std::string const &filename, std::string const &src)
+        {
+            // Create shader object
+            const char * source = src.c_str();
+            auto shader = create(filename);
+            glShaderSource(shader, 1, &source, nullptr);
+            glCompileShader(shader);
+
+            glAttachShader(mProgram, shader);
+            mCompiling.push_back(std::make_pair(shader, filename));
+        }
+
+        /* 64 bit FNV-1a hash of a string, continuing from hash */
+        static uint64_t hashString(std::string const &text, uint64_t hash)
+        {
+            for (unsigned char c : text)
+            {
+                hash ^= c;
+                hash *= 0x100000001b3ull;
+            }
+            // Separates consecutive strings, so "ab" + "c" and "a" + "bc" differ
+            hash ^= 0xff;
+            hash *= 0x100000001b3ull;
+            return hash;
+        }
+
+        /* Name of the cache file for the attached sources on this driver,
+           or an empty string if binaries are not cached */
+        std::string binaryCacheFile()
+        {
+            std::string const &directory = binaryCacheDirectory();
+            if (directory.empty() || mSources.empty())
+                return "";
+
+            GLint formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            if (formats == 0)
+                return "";
+
+            // A binary only fits the driver that made it, so the driver is
+            // part of the key. The sources include any injected defines.
+            uint64_t hash = 0xcbf29ce484222325ull;
+            hash = hashString((const char *) glGetString(GL_VENDOR), hash);
+            hash = hashString((const char *) glGetString(GL_RENDERER), hash);
+            hash = hashString((const char *) glGetString(GL_VERSION), hash);
+            for (auto const &source : mSources)
+            {
+                hash = hashString(source.filename.substr(source.filename.rfind(".") + 1), hash);
+                hash = hashString(source.text, hash);
+            }
+
+            char name[32];
+            snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) hash);
+            return directory + "/" + name;
+        }
+
+        /* Loads a cached binary into the program. Returns false if there
+           is none or the driver rejects it. */
+        bool loadBinary(std::string const &cacheFile)
+        {
+            FILE * file = fopen(cacheFile.c_str(), "rb");
+            if (file == nullptr)
+                return false;
+
+            uint32_t header[3] = { 0, 0, 0 };
+            std::vector<char> binary;
+            if (fread(header, sizeof(header), 1, file) == 1 && header[0] == BINARY_CACHE_MAGIC)
+            {
+                binary.resize(header[2]);
+                if (fread(binary.data(), 1, binary.size(), file) != binary.size())
+                    binary.clear();
+            }
+            fclose(file);
+            if (binary.empty())
+                return false;
+
+            glProgramBinary(mProgram, (GLenum) header[1], binary.data(), (GLsizei) binary.size());
+            glGetProgramiv(mProgram, GL_LINK_STATUS, &mStatus);
+            return mStatus == GL_TRUE;
+        }
+
+        /* Writes the linked program's binary to the cache */
+        void saveBinary(std::string const &cacheFile)
+        {
+            GLint length = 0;
+            glGetProgramiv(mProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+            if (length <= 0)
+                return;
+
+            std::vector<char> binary(length);
+            GLenum format = 0;
+            glGetProgramBinary(mProgram, length, nullptr, &format, binary.data());
+
+            // Written under a name of this process and renamed, so neither a
+            // crash nor a second instance saving the same program at the
+            // same time leaves a partial file under the real name
+#ifdef _WIN32
+            long process = (long) _getpid();
+#else
+            long process = (long) getpid();
+#endif
+            std::string temporaryFile = cacheFile + "." + std::to_string(process) + ".tmp";
+            FILE * file = fopen(temporaryFile.c_str(), "wb");
+            if (file == nullptr)
+                return;
+            uint32_t header[3] = { BINARY_CACHE_MAGIC, (uint32_t) format, (uint32_t) length };
+            bool written = fwrite(header, sizeof(header), 1, file) == 1
+                        && fwrite(binary.data(), 1, binary.size(), file) == binary.size();
+            written = (fclose(file) == 0) && written;
+            if (!written || std::rename(temporaryFile.c_str(), cacheFile.c_str()) != 0)
+                std::remove(temporaryFile.c_str());
+        }
+
         // Private member variables
         GLuint mProgram;
         GLint  mStatus;
         GLint  mLength;
+        std::vector<Source> mSources;
+
+        // Set from linkAsync() until finish(), with the shaders being
+        // compiled by file name and the cache file to save the binary to
+        bool mLinking;
+        std::vector<std::pair<GLuint, std::string>> mCompiling;
+        std::string mCacheFile;
+    };
+
+
+    /* The variants of a program made from one vertex and one fragment
+       shader, each compiled with its own set of defines. A variant is
+       compiled the first time it is asked for, or ahead of time through
+       request(), and the same set of defines always gives the same
+       program. Every variant is specialised at compile time, so the
+       shaders need no uniforms or branches to choose between features. */
+    class ShaderVariants
+    {
+    public:
+        ShaderVariants(std::string const &vertexFilename,
+                       std::string const &fragmentFilename)
+            : mVertexFilename(vertexFilename), mFragmentFilename(fragmentFilename) { }
+
+        /* Returns the variant for a set of defines, compiling it if needed
+           and waiting until it can be used */
+        Shader & get(ShaderDefines const &defines)
+        {
+            Shader &variant = request(defines);
+            variant.finish();
+            return variant;
+        }
+
+        /* Returns the variant for a set of defines, starting to compile it
+           if needed without waiting for it (see Shader::linkAsync()).
+           Requesting every variant up front lets them compile together. */
+        Shader & request(ShaderDefines const &defines)
+        {
+            std::unique_ptr<Shader> &variant = mVariants[defines.text()];
+            if (!variant)
+            {
+                variant.reset(new Shader());
+                variant->attach(mVertexFilename, defines);
+                variant->attach(mFragmentFilename, defines);
+                variant->linkAsync();
+            }
+            return *variant;
+        }
+
+        /* Starts compiling a variant rather than when it is first used */
+        void precompile(ShaderDefines const &defines) { request(defines); }
+
+        /* Number of distinct variants compiled */
+        size_t size() const { return mVariants.size(); }
+
+        /* Deletes the programs of all variants */
+        void destroy()
+        {
+            for (auto &variant : mVariants)
+                variant.second->destroy();
+            mVariants.clear();
+        }
+
+    private:
+        // Disable copying and assignment
+        ShaderVariants(ShaderVariants const &) = delete;
+        ShaderVariants & operator =(ShaderVariants const &) = delete;
+
+        std::string mVertexFilename;
+        std::string mFragmentFilename;
+
+        // Keyed by the text of the defines
+        std::map<std::string, std::unique_ptr<Shader>> mVariants;
     };
 }
 
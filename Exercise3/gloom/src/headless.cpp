@@ -0,0 +1,206 @@
+#include "headless.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+// Only the EGL headers are needed at build time, the library itself is opened when a headless context is requested
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<EGL/egl.h>) && __has_include(<EGL/eglext.h>)
+#define HEADLESS_EGL
+#endif
+#endif
+
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <dlfcn.h>
+#endif
+
+
+#ifdef HEADLESS_EGL
+
+// The EGL entry points used here, looked up in libEGL once it is opened
+struct EGLFunctions {
+    PFNEGLGETPROCADDRESSPROC getProcAddress;
+    PFNEGLQUERYSTRINGPROC queryString;
+    PFNEGLINITIALIZEPROC initialize;
+    PFNEGLTERMINATEPROC terminate;
+    PFNEGLBINDAPIPROC bindAPI;
+    PFNEGLCREATECONTEXTPROC createContext;
+    PFNEGLDESTROYCONTEXTPROC destroyContext;
+    PFNEGLMAKECURRENTPROC makeCurrent;
+};
+
+static void* egl_library = nullptr;
+static EGLFunctions egl;
+static EGLDisplay headless_display = EGL_NO_DISPLAY;
+static EGLContext headless_context = EGL_NO_CONTEXT;
+
+/* Looks up an EGL function in the opened library */
+template <typename Function>
+static bool load_egl_function(Function& function, const char* name) {
+    function = reinterpret_cast<Function>(dlsym(egl_library, name));
+    return function != nullptr;
+}
+
+/* Tells whether a space separated extension string contains an extension */
+static bool has_extension(const char* extensions, const char* name) {
+    if (extensions == nullptr) {
+        return false;
+    }
+    size_t length = std::strlen(name);
+    for (const char* position = std::strstr(extensions, name); position != nullptr; position = std::strstr(position + 1, name)) {
+        bool starts = (position == extensions) || (position[-1] == ' ');
+        bool ends = (position[length] == ' ') || (position[length] == '\0');
+        if (starts && ends) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* glad asks for every OpenGL function by name */
+static void* get_gl_function(const char* name) {
+    return reinterpret_cast<void*>(egl.getProcAddress(name));
+}
+
+bool createHeadlessContext() {
+    egl_library = dlopen("libEGL.so.1", RTLD_NOW | RTLD_LOCAL);
+    if (egl_library == nullptr) {
+        fprintf(stderr, "Headless: could not open libEGL (%s)\n", dlerror());
+        return false;
+    }
+
+    bool loaded = load_egl_function(egl.getProcAddress, "eglGetProcAddress")
+               && load_egl_function(egl.queryString, "eglQueryString")
+               && load_egl_function(egl.initialize, "eglInitialize")
+               && load_egl_function(egl.terminate, "eglTerminate")
+               && load_egl_function(egl.bindAPI, "eglBindAPI")
+               && load_egl_function(egl.createContext, "eglCreateContext")
+               && load_egl_function(egl.destroyContext, "eglDestroyContext")
+               && load_egl_function(egl.makeCurrent, "eglMakeCurrent");
+    if (!loaded) {
+        fprintf(stderr, "Headless: libEGL lacks required functions\n");
+        destroyHeadlessContext();
+        return false;
+    }
+
+    // The surfaceless platform needs neither a display server nor a GPU device node
+    const char* client_extensions = egl.queryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(egl.getProcAddress("eglGetPlatformDisplayEXT"));
+    if (!has_extension(client_extensions, "EGL_MESA_platform_surfaceless") || get_platform_display == nullptr) {
+        fprintf(stderr, "Headless: EGL_MESA_platform_surfaceless is not supported\n");
+        destroyHeadlessContext();
+        return false;
+    }
+
+    headless_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    EGLint major = 0;
+    EGLint minor = 0;
+    if (headless_display == EGL_NO_DISPLAY || !egl.initialize(headless_display, &major, &minor)) {
+        fprintf(stderr, "Headless: could not initialise the surfaceless EGL display\n");
+        headless_display = EGL_NO_DISPLAY;
+        destroyHeadlessContext();
+        return false;
+    }
+
+    // Without a surface, the context needs no config either
+    const char* display_extensions = egl.queryString(headless_display, EGL_EXTENSIONS);
+    if (!has_extension(display_extensions, "EGL_KHR_surfaceless_context")
+        || !has_extension(display_extensions, "EGL_KHR_no_config_context")
+        || !egl.bindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "Headless: EGL %d.%d cannot create surfaceless desktop OpenGL contexts\n", major, minor);
+        destroyHeadlessContext();
+        return false;
+    }
+
+    // The same version and profile as the GLFW window in main.cpp
+    const EGLint context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    headless_context = egl.createContext(headless_display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attributes);
+    if (headless_context == EGL_NO_CONTEXT
+        || !egl.makeCurrent(headless_display, EGL_NO_SURFACE, EGL_NO_SURFACE, headless_context)) {
+        fprintf(stderr, "Headless: could not create an OpenGL 4.3 core context\n");
+        destroyHeadlessContext();
+        return false;
+    }
+
+    if (!gladLoadGLLoader(get_gl_function)) {
+        fprintf(stderr, "Headless: could not load the OpenGL functions\n");
+        destroyHeadlessContext();
+        return false;
+    }
+    return true;
+}
+
+void destroyHeadlessContext() {
+    if (headless_display != EGL_NO_DISPLAY) {
+        egl.makeCurrent(headless_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (headless_context != EGL_NO_CONTEXT) {
+            egl.destroyContext(headless_display, headless_context);
+        }
+        egl.terminate(headless_display);
+    }
+    headless_context = EGL_NO_CONTEXT;
+    headless_display = EGL_NO_DISPLAY;
+
+    if (egl_library != nullptr) {
+        dlclose(egl_library);
+        egl_library = nullptr;
+    }
+}
+
+#else
+
+bool createHeadlessContext() {
+    fprintf(stderr, "Headless: this build has no EGL support\n");
+    return false;
+}
+
+void destroyHeadlessContext() {
+}
+
+#endif
+
+
+OffscreenTarget createOffscreenTarget(int width, int height) {
+    OffscreenTarget target;
+    target.width = width;
+    target.height = height;
+
+    glGenFramebuffers(1, &target.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+
+    glGenRenderbuffers(1, &target.colourBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, target.colourBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.colourBuffer);
+
+    glGenRenderbuffers(1, &target.depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, target.depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.depthBuffer);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Headless: the offscreen framebuffer is incomplete\n");
+    }
+
+    glViewport(0, 0, width, height);
+    return target;
+}
+
+void destroyOffscreenTarget(OffscreenTarget& target) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteRenderbuffers(1, &target.colourBuffer);
+    glDeleteRenderbuffers(1, &target.depthBuffer);
+    glDeleteFramebuffers(1, &target.framebuffer);
+    target.framebuffer = 0;
+    target.colourBuffer = 0;
+    target.depthBuffer = 0;
+}
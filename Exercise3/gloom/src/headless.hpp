@@ -0,0 +1,33 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+#pragma once
+
+
+// System headers
+#include <glad/glad.h>
+
+
+// Creates an OpenGL 4.3 core context that belongs to no window or display, using EGL on Mesa's surfaceless platform,
+// makes it current and loads the OpenGL functions. libEGL is loaded at run time, so the program neither links against
+// it nor needs it unless this is called. Returns false if EGL, the platform or such a context is not available.
+bool createHeadlessContext();
+
+// Releases the context created by createHeadlessContext()
+void destroyHeadlessContext();
+
+
+// A framebuffer object with colour and depth attachments, drawn to instead of a window's default framebuffer
+struct OffscreenTarget {
+    GLuint framebuffer;
+    GLuint colourBuffer;
+    GLuint depthBuffer;
+    int width;
+    int height;
+};
+
+// Creates an offscreen target of the given size, binds it for drawing and sets the viewport to cover it
+OffscreenTarget createOffscreenTarget(int width, int height);
+void destroyOffscreenTarget(OffscreenTarget& target);
+
+
+#endif
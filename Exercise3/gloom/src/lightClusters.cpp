@@ -0,0 +1,229 @@
+#include "lightClusters.hpp"
+#include "simd.hpp"
+#include "memoryTracker.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+
+/* Bit i is set when tile i, between tile planes i and i + 1, may hold part of a sphere of radius around a view space
+   centre with coordinates (a, z), a being x for columns and y for rows. The signed distance of the centre to plane i
+   is a * normalA[i] + z * normalZ[i], positive towards higher tiles. The sphere reaches tile i if it reaches in front
+   of plane i and behind plane i + 1. */
+#if defined(SIMD_SSE)
+static unsigned int tile_mask(const float* normalA, const float* normalZ, int tiles, float a, float z, float radius) {
+    const __m128 a4 = _mm_set1_ps(a), z4 = _mm_set1_ps(z);
+    const __m128 radius4 = _mm_set1_ps(radius), negative_radius4 = _mm_set1_ps(-radius);
+
+    unsigned int in_front = 0;
+    unsigned int behind = 0;
+    for (int i = 0; i <= tiles; i += 4) {
+        __m128 distance = _mm_add_ps(_mm_mul_ps(_mm_load_ps(normalA + i), a4), _mm_mul_ps(_mm_load_ps(normalZ + i), z4));
+        in_front |= (unsigned int)_mm_movemask_ps(_mm_cmpgt_ps(distance, negative_radius4)) << i;
+        behind |= (unsigned int)_mm_movemask_ps(_mm_cmplt_ps(distance, radius4)) << i;
+    }
+    return in_front & (behind >> 1) & ((1u << tiles) - 1);
+}
+#else
+static unsigned int tile_mask(const float* normalA, const float* normalZ, int tiles, float a, float z, float radius) {
+    unsigned int in_front = 0;
+    unsigned int behind = 0;
+    for (int i = 0; i <= tiles; i++) {
+        float distance = a * normalA[i] + z * normalZ[i];
+        in_front |= (unsigned int)(distance > -radius) << i;
+        behind |= (unsigned int)(distance < radius) << i;
+    }
+    return in_front & (behind >> 1) & ((1u << tiles) - 1);
+}
+#endif
+
+static int lowest_bit(unsigned int mask) {
+    int bit = 0;
+    while (!(mask & (1u << bit))) {
+        bit++;
+    }
+    return bit;
+}
+
+static int highest_bit(unsigned int mask) {
+    int bit = 31;
+    while (!(mask & (1u << bit))) {
+        bit--;
+    }
+    return bit;
+}
+
+
+LightClusters::LightClusters()
+    : nearDepth(1.0f), farDepth(1.0f), scale(0.0f), clusterList(CLUSTER_COUNT), memoryBytes(0) {
+    std::fill(columnNormalX, columnNormalX + CLUSTER_COLUMNS + 4, 0.0f);
+    std::fill(columnNormalZ, columnNormalZ + CLUSTER_COLUMNS + 4, 0.0f);
+    std::fill(rowNormalY, rowNormalY + CLUSTER_ROWS + 4, 0.0f);
+    std::fill(rowNormalZ, rowNormalZ + CLUSTER_ROWS + 4, 0.0f);
+    for (LightCluster& cluster : clusterList) {
+        cluster.firstIndex = 0;
+        cluster.count = 0;
+    }
+    trackMemory();
+}
+
+LightClusters::~LightClusters() {
+    memoryTrack(MEMORY_CPU, "lighting/clusters", -(int64_t)memoryBytes);
+}
+
+/* The tile planes pass through the eye and the tile edges on the near plane. A point is on an edge between columns when
+   x / -z = ndc / P[0][0], ndc being the edge's normalised device x, so the plane's normal is (1, 0, ndc / P[0][0]).
+   The near and far depth come from the depth terms of the projection. */
+void LightClusters::setupPlanes(const glm::mat4& projection, glm::vec2 viewportSize) {
+    for (int i = 0; i <= CLUSTER_COLUMNS; i++) {
+        float slope = (2.0f * i / CLUSTER_COLUMNS - 1.0f) / projection[0][0];
+        float length = std::sqrt(1.0f + slope * slope);
+        columnNormalX[i] = 1.0f / length;
+        columnNormalZ[i] = slope / length;
+    }
+    for (int i = 0; i <= CLUSTER_ROWS; i++) {
+        float slope = (2.0f * i / CLUSTER_ROWS - 1.0f) / projection[1][1];
+        float length = std::sqrt(1.0f + slope * slope);
+        rowNormalY[i] = 1.0f / length;
+        rowNormalZ[i] = slope / length;
+    }
+
+    nearDepth = projection[3][2] / (projection[2][2] - 1.0f);
+    farDepth = projection[3][2] / (projection[2][2] + 1.0f);
+
+    float slice_scale = CLUSTER_SLICES / std::log(farDepth / nearDepth);
+    scale = glm::vec4(CLUSTER_COLUMNS / viewportSize.x, CLUSTER_ROWS / viewportSize.y,
+                      slice_scale, -slice_scale * std::log(nearDepth));
+}
+
+int LightClusters::sliceOf(float depth) const {
+    int slice = (int)std::floor(std::log(depth) * scale.z + scale.w);
+    return std::min(std::max(slice, 0), CLUSTER_SLICES - 1);
+}
+
+LightClusters::ClusterRange LightClusters::findClusterRange(const glm::mat4& view, const PointLight& light) const {
+    ClusterRange range = { { 0, 0, 0 }, { -1, -1, -1 } };
+    glm::vec3 centre = glm::vec3(view * glm::vec4(light.position, 1.0f));
+
+    float depth = -centre.z;
+    if (light.radius <= 0.0f || depth + light.radius < nearDepth || depth - light.radius > farDepth) {
+        return range;
+    }
+
+    unsigned int columns = tile_mask(columnNormalX, columnNormalZ, CLUSTER_COLUMNS, centre.x, centre.z, light.radius);
+    unsigned int rows = tile_mask(rowNormalY, rowNormalZ, CLUSTER_ROWS, centre.y, centre.z, light.radius);
+    if (columns == 0 || rows == 0) {
+        return range;
+    }
+
+    range.first[0] = lowest_bit(columns);
+    range.last[0] = highest_bit(columns);
+    range.first[1] = lowest_bit(rows);
+    range.last[1] = highest_bit(rows);
+    range.first[2] = sliceOf(std::max(depth - light.radius, nearDepth));
+    range.last[2] = sliceOf(std::min(depth + light.radius, farDepth));
+    return range;
+}
+
+/* Counts the lights of every cluster of a slice */
+void LightClusters::countSlice(unsigned int slice) {
+    LightCluster* clusters = &clusterList[slice * CLUSTER_COLUMNS * CLUSTER_ROWS];
+    for (unsigned int i = 0; i < CLUSTER_COLUMNS * CLUSTER_ROWS; i++) {
+        clusters[i].count = 0;
+    }
+
+    for (const ClusterRange& range : ranges) {
+        if ((int)slice < range.first[2] || (int)slice > range.last[2]) {
+            continue;
+        }
+        for (int y = range.first[1]; y <= range.last[1]; y++) {
+            for (int x = range.first[0]; x <= range.last[0]; x++) {
+                clusters[y * CLUSTER_COLUMNS + x].count++;
+            }
+        }
+    }
+}
+
+/* Writes the lights of every cluster of a slice into its range of the index list, in the order of the lights */
+void LightClusters::fillSlice(unsigned int slice) {
+    LightCluster* clusters = &clusterList[slice * CLUSTER_COLUMNS * CLUSTER_ROWS];
+
+    for (size_t i = 0; i < ranges.size(); i++) {
+        const ClusterRange& range = ranges[i];
+        if ((int)slice < range.first[2] || (int)slice > range.last[2]) {
+            continue;
+        }
+        for (int y = range.first[1]; y <= range.last[1]; y++) {
+            for (int x = range.first[0]; x <= range.last[0]; x++) {
+                LightCluster& cluster = clusters[y * CLUSTER_COLUMNS + x];
+                indexList[cluster.firstIndex + cluster.count++] = (uint32_t)i;
+            }
+        }
+    }
+}
+
+/* Three passes: the cluster range of every light, the number of lights of every cluster, and after the clusters have
+   been given their place in the index list, the indices. Each slice is counted and filled by a single task. */
+void LightClusters::build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+                          glm::vec2 viewportSize, ThreadPool* pool) {
+    PROFILE_ZONE("Bin lights");
+    setupPlanes(projection, viewportSize);
+    sceneLights = lights;
+    ranges.resize(lights.size());
+
+    std::function<void(size_t, size_t)> find_ranges = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            ranges[i] = findClusterRange(view, sceneLights[i]);
+        }
+    };
+    std::function<void(size_t, size_t)> count_slices = [&](size_t begin, size_t end) {
+        for (size_t slice = begin; slice < end; slice++) {
+            countSlice((unsigned int)slice);
+        }
+    };
+    std::function<void(size_t, size_t)> fill_slices = [&](size_t begin, size_t end) {
+        for (size_t slice = begin; slice < end; slice++) {
+            fillSlice((unsigned int)slice);
+        }
+    };
+
+    if (pool != nullptr) {
+        pool->parallelFor(ranges.size(), LIGHT_GRAIN_SIZE, find_ranges);
+        pool->parallelFor(CLUSTER_SLICES, 1, count_slices);
+    } else {
+        find_ranges(0, ranges.size());
+        count_slices(0, CLUSTER_SLICES);
+    }
+
+    // Every cluster's lights follow those of the clusters before it
+    uint32_t total = 0;
+    for (LightCluster& cluster : clusterList) {
+        cluster.firstIndex = total;
+        total += cluster.count;
+        cluster.count = 0;
+    }
+    indexList.resize(total);
+
+    if (pool != nullptr) {
+        pool->parallelFor(CLUSTER_SLICES, 1, fill_slices);
+    } else {
+        fill_slices(0, CLUSTER_SLICES);
+    }
+
+    trackMemory();
+}
+
+/* Reports "lighting/clusters" after each build. The cluster list has a fixed size, while the light, range and
+   index lists grow with the lights in view and the clusters they overlap, so only those change the count. */
+void LightClusters::trackMemory() {
+    uint64_t bytes = (uint64_t)sceneLights.capacity() * sizeof(PointLight)
+                   + (uint64_t)ranges.capacity() * sizeof(ClusterRange)
+                   + (uint64_t)clusterList.capacity() * sizeof(LightCluster)
+                   + (uint64_t)indexList.capacity() * sizeof(uint32_t);
+    if (bytes != memoryBytes) {
+        memoryTrack(MEMORY_CPU, "lighting/clusters", (int64_t)bytes - (int64_t)memoryBytes);
+        memoryBytes = bytes;
+    }
+}
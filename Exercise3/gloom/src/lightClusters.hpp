@@ -0,0 +1,106 @@
+#ifndef LIGHT_CLUSTERS_HPP
+#define LIGHT_CLUSTERS_HPP
+#pragma once
+
+
+// System headers
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Local headers
+#include "threadPool.hpp"
+
+
+// Size of the cluster grid: columns and rows of screen tiles, and depth slices of each tile.
+// Slices get thicker with distance, as the depth of a slice grows with the log of the view depth.
+#define CLUSTER_COLUMNS 16
+#define CLUSTER_ROWS 9
+#define CLUSTER_SLICES 24
+#define CLUSTER_COUNT (CLUSTER_COLUMNS * CLUSTER_ROWS * CLUSTER_SLICES)
+
+// Lights whose cluster ranges are computed by one task
+#define LIGHT_GRAIN_SIZE 64
+
+
+// A point light in world coordinates, lighting everything within radius of its position.
+// The layout is that of the PointLight struct of the shaders (std430), so lights are uploaded as they are.
+struct PointLight {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 colour;
+    float intensity;
+};
+
+// The lights of one cluster: count indices in the light index list, starting at firstIndex
+struct LightCluster {
+    uint32_t firstIndex;
+    uint32_t count;
+};
+
+
+// Sorts the lights of a frame into a grid of clusters, boxes of view space made from screen tiles split up in depth,
+// so that a fragment only shades the lights reaching its cluster rather than every light in the scene.
+// Each cluster ends up with a range of a compact light index list, and the clusters of a slice are consecutive
+// (column first, then row). Lights are binned into all clusters the bounding box of their sphere in grid
+// coordinates overlaps, tested against the tile planes four at a time with SSE where available.
+class LightClusters {
+public:
+    LightClusters();
+    ~LightClusters();
+
+    // Bins lights for a camera with a symmetric perspective projection, as made by glm::perspective,
+    // and a viewport of viewportSize pixels. If a pool is given, lights and slices are processed in parallel.
+    void build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+               glm::vec2 viewportSize, ThreadPool* pool = nullptr);
+
+    // The lights of the last build(), every cluster's range of lightIndices(), and the list itself
+    const std::vector<PointLight>& lights() const { return sceneLights; }
+    const std::vector<LightCluster>& clusters() const { return clusterList; }
+    const std::vector<uint32_t>& lightIndices() const { return indexList; }
+
+    // Turns a fragment into its cluster: x and y are clusters per pixel, z and w the scale and bias taking the
+    // log of the view depth to the slice
+    glm::vec4 clusterScale() const { return scale; }
+
+private:
+    LightClusters(LightClusters const &) = delete;
+    LightClusters & operator =(LightClusters const &) = delete;
+
+    // The clusters a light's sphere may reach, inclusive. first > last along any axis if it reaches none.
+    struct ClusterRange {
+        int first[3];
+        int last[3];
+    };
+
+    void setupPlanes(const glm::mat4& projection, glm::vec2 viewportSize);
+    ClusterRange findClusterRange(const glm::mat4& view, const PointLight& light) const;
+    int sliceOf(float depth) const;
+    void countSlice(unsigned int slice);
+    void fillSlice(unsigned int slice);
+    void trackMemory();
+
+    // Normals (x or y, z) of the planes through the eye between the tile columns and rows, padded with zeros to
+    // a multiple of four
+    alignas(16) float columnNormalX[CLUSTER_COLUMNS + 4];
+    alignas(16) float columnNormalZ[CLUSTER_COLUMNS + 4];
+    alignas(16) float rowNormalY[CLUSTER_ROWS + 4];
+    alignas(16) float rowNormalZ[CLUSTER_ROWS + 4];
+
+    float nearDepth;
+    float farDepth;
+    glm::vec4 scale;
+
+    std::vector<PointLight> sceneLights;
+    std::vector<ClusterRange> ranges;
+    std::vector<LightCluster> clusterList;
+    std::vector<uint32_t> indexList;
+
+    // CPU bytes of the arrays above, as last given to the memory tracker
+    uint64_t memoryBytes;
+};
+
+
+#endif
@@ -1,6 +1,7 @@
 // Local headers
 #include "gloom/gloom.hpp"
 #include "program.hpp"
+#include "microbenchmarks.hpp"
 
 // System headers
 #include <glad/glad.h>
@@ -8,6 +9,19 @@
 
 // Standard headers
 #include <cstdlib>
+#include <string>
+
+// Frames rendered in headless mode unless a count is given
+#define DEFAULT_HEADLESS_FRAMES 600
+
+// Benchmark defaults: frames measured after the warmup, simulated seconds per frame and where the report goes
+#define DEFAULT_BENCHMARK_FRAMES 1200
+#define DEFAULT_BENCHMARK_WARMUP 60
+#define DEFAULT_BENCHMARK_DT (1.0 / 60.0)
+#define DEFAULT_BENCHMARK_REPORT "benchmark.json"
+
+// Frames a trace covers unless a count is given
+#define DEFAULT_TRACE_FRAMES 120
 
 
 // A callback which allows GLFW to report errors whenever they occur
@@ -17,7 +31,18 @@ static void glfwErrorCallback(int error, const char *description)
 }
 
 
-GLFWwindow* initialise()
+// Prints various OpenGL information to stdout
+static void printContextInformation()
+{
+    printf("%s: %s\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER));
+    printf("GLFW\t %s\n", glfwGetVersionString());
+    printf("OpenGL\t %s\n", glGetString(GL_VERSION));
+    printf("GLSL\t %s\n\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
+}
+
+
+// Creates the window and its OpenGL context. An invisible window still has a context to render offscreen with.
+GLFWwindow* initialise(bool visible = true)
 {
     // Initialise GLFW
     if (!glfwInit())
@@ -37,6 +62,7 @@ GLFWwindow* initialise()
     // Set additional window options
     glfwWindowHint(GLFW_RESIZABLE, windowResizable);
     glfwWindowHint(GLFW_SAMPLES, windowSamples);  // MSAA
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
     // Create window using GLFW
     GLFWwindow* window = glfwCreateWindow(windowWidth,
@@ -57,23 +83,236 @@ GLFWwindow* initialise()
     glfwMakeContextCurrent(window);
     gladLoadGL();
 
-    // Print various OpenGL information to stdout
-    printf("%s: %s\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER));
-    printf("GLFW\t %s\n", glfwGetVersionString());
-    printf("OpenGL\t %s\n", glGetString(GL_VERSION));
-    printf("GLSL\t %s\n\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
+    printContextInformation();
 
     return window;
 }
 
 
+// Reads an option any run accepts, with its value. Returns false if the option is not one of them.
+//   --trace FILE          Chrome trace of the last frames, written on exit
+//   --trace-frames N      frames the trace covers, 0 for all zones kept
+//   --startup-trace FILE  Chrome trace of loading the scene, written after the first frame
+//   --record-camera FILE  camera pose of every frame, to replay with --benchmark --camera FILE
+//   --stats-log FILE      renderer statistics at every periodic report
+//   --shader-cache DIR    where compiled shader programs are cached, "" to always compile them
+//   --point-lights 0|1    whether the landing pads and helicopters light the scene
+static bool parseCommonOption(const std::string& option, const char* value, ProgramOptions& options)
+{
+    if (option == "--trace")
+        options.traceFile = value;
+    else if (option == "--trace-frames")
+        options.traceFrames = (unsigned int)std::strtoul(value, nullptr, 10);
+    else if (option == "--startup-trace")
+        options.startupTraceFile = value;
+    else if (option == "--record-camera")
+        options.cameraRecordFile = value;
+    else if (option == "--stats-log")
+        options.statsLogFile = value;
+    else if (option == "--shader-cache")
+        options.shaderCacheDirectory = value;
+    else if (option == "--point-lights")
+        options.pointLights = std::strtoul(value, nullptr, 10) != 0;
+    else
+        return false;
+    return true;
+}
+
+
+// Reads the options from argb[first] onwards, each followed by its value. Returns false on an unknown or incomplete option.
+static bool parseCommonOptions(int first, int argc, char* argb[], ProgramOptions& options)
+{
+    for (int i = first; i < argc; i += 2)
+    {
+        if (i + 1 >= argc || !parseCommonOption(argb[i], argb[i + 1], options))
+        {
+            fprintf(stderr, "Unknown or incomplete option %s\n", argb[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Renders offscreen through a surfaceless EGL context where possible, otherwise through an invisible window
+// (which still needs a display server, e.g. Xvfb)
+static void runOffscreen(const ProgramOptions& options)
+{
+    if (createHeadlessContext())
+    {
+        printContextInformation();
+        runProgram(nullptr, options);
+        destroyHeadlessContext();
+        return;
+    }
+
+    fprintf(stderr, "Falling back to an invisible GLFW window\n");
+    GLFWwindow* window = initialise(false);
+    runProgram(window, options);
+    glfwTerminate();
+}
+
+
+// Benchmark: a fixed number of frames offscreen, with a fixed simulated frame time and a scripted or recorded camera,
+// so that every run renders exactly the same frames. Reads its options from argb[2] onwards.
+static int runBenchmark(int argc, char* argb[])
+{
+    ProgramOptions options;
+    options.offscreen = true;
+    options.traceFrames = DEFAULT_TRACE_FRAMES;
+    options.frameCount = DEFAULT_BENCHMARK_FRAMES;
+    options.warmupFrames = DEFAULT_BENCHMARK_WARMUP;
+    options.frameSeconds = DEFAULT_BENCHMARK_DT;
+    options.reportFile = DEFAULT_BENCHMARK_REPORT;
+    std::string camera_file;
+
+    // High-water marks of the tracked memory the run must stay within, in megabytes, or 0 for no limit
+    double cpu_budget = 0.0;
+    double gpu_budget = 0.0;
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::string option = argb[i];
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "Benchmark option %s needs a value\n", option.c_str());
+            return EXIT_FAILURE;
+        }
+        const char* value = argb[++i];
+
+        if (option == "--frames")
+            options.frameCount = (unsigned int)std::strtoul(value, nullptr, 10);
+        else if (option == "--warmup")
+            options.warmupFrames = (unsigned int)std::strtoul(value, nullptr, 10);
+        else if (option == "--helicopters")
+            options.helicopterCount = (unsigned int)std::strtoul(value, nullptr, 10);
+        else if (option == "--dt")
+            options.frameSeconds = std::strtod(value, nullptr);
+        else if (option == "--camera")
+            camera_file = value;
+        else if (option == "--report")
+            options.reportFile = value;
+        else if (option == "--cpu-memory-budget")
+            cpu_budget = std::strtod(value, nullptr);
+        else if (option == "--gpu-memory-budget")
+            gpu_budget = std::strtod(value, nullptr);
+        else if (!parseCommonOption(option, value, options))
+        {
+            fprintf(stderr, "Unknown benchmark option %s\n", option.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The measured frames come after the warmup, and a zero frame time would follow the real time
+    if (options.frameCount == 0 || options.frameSeconds <= 0.0)
+    {
+        fprintf(stderr, "Benchmark needs a positive frame count and frame time\n");
+        return EXIT_FAILURE;
+    }
+    options.frameCount += options.warmupFrames;
+
+    CameraPath camera_path;
+    if (camera_file.empty())
+    {
+        camera_path = CameraPath::scripted();
+        options.cameraPathName = "scripted";
+    }
+    else if (camera_path.load(camera_file))
+    {
+        options.cameraPathName = camera_file;
+    }
+    else
+    {
+        fprintf(stderr, "Could not read the camera path %s\n", camera_file.c_str());
+        return EXIT_FAILURE;
+    }
+    options.cameraPath = &camera_path;
+
+    runOffscreen(options);
+
+    // A failing exit status lets automated runs hold the memory budgets
+    double cpu_peak = memoryPeak(MEMORY_CPU) / (1024.0 * 1024.0);
+    double gpu_peak = memoryPeak(MEMORY_GPU) / (1024.0 * 1024.0);
+    bool within_budget = true;
+    if (cpu_budget > 0.0 && cpu_peak > cpu_budget)
+    {
+        fprintf(stderr, "CPU memory peaked at %.2f MB, over the budget of %.2f MB\n", cpu_peak, cpu_budget);
+        within_budget = false;
+    }
+    if (gpu_budget > 0.0 && gpu_peak > gpu_budget)
+    {
+        fprintf(stderr, "GPU memory peaked at %.2f MB, over the budget of %.2f MB\n", gpu_peak, gpu_budget);
+        within_budget = false;
+    }
+    return within_budget ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
 int main(int argc, char* argb[])
 {
+    // CPU microbenchmarks run without a window
+    if (argc > 1 && std::string(argb[1]) == "--bench-transforms")
+    {
+        runTransformMicrobenchmark();
+        return EXIT_SUCCESS;
+    }
+    if (argc > 1 && std::string(argb[1]) == "--bench-bvh")
+    {
+        runBVHMicrobenchmark();
+        return EXIT_SUCCESS;
+    }
+    if (argc > 1 && std::string(argb[1]) == "--bench-spawn")
+    {
+        runSpawnMicrobenchmark();
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 1 && std::string(argb[1]) == "--benchmark")
+    {
+        return runBenchmark(argc, argb);
+    }
+
+    // Headless: render a fixed number of frames offscreen
+    if (argc > 1 && std::string(argb[1]) == "--headless")
+    {
+        ProgramOptions options;
+        options.offscreen = true;
+        options.traceFrames = DEFAULT_TRACE_FRAMES;
+        options.frameCount = DEFAULT_HEADLESS_FRAMES;
+
+        // The frame count is optional, other options follow it
+        int first_option = 2;
+        if (argc > 2 && argb[2][0] != '-')
+        {
+            options.frameCount = (unsigned int)std::strtoul(argb[2], nullptr, 10);
+            first_option = 3;
+        }
+        if (options.frameCount == 0)
+        {
+            options.frameCount = DEFAULT_HEADLESS_FRAMES;
+        }
+        if (!parseCommonOptions(first_option, argc, argb, options))
+        {
+            return EXIT_FAILURE;
+        }
+
+        runOffscreen(options);
+        return EXIT_SUCCESS;
+    }
+
+    // The interactive run takes the common options, e.g. flying around with the camera recorded gives a benchmark path
+    ProgramOptions options;
+    options.traceFrames = DEFAULT_TRACE_FRAMES;
+    if (!parseCommonOptions(1, argc, argb, options))
+    {
+        return EXIT_FAILURE;
+    }
+
     // Initialise window using GLFW
     GLFWwindow* window = initialise();
 
     // Run an OpenGL application using this window
-    runProgram(window);
+    runProgram(window, options);
 
     // Terminate GLFW (no need to call glfwDestroyWindow)
     glfwTerminate();
@@ -0,0 +1,113 @@
+#include "memoryTracker.hpp"
+
+#include <map>
+#include <mutex>
+#include <utility>
+
+
+// Everything tracked. Categories are kept by domain and name, so they come out in report order.
+struct MemoryTracker {
+    std::mutex mutex;
+    std::map<std::pair<int, std::string>, MemoryCategory> categories;
+    uint64_t totals[2];
+    uint64_t peaks[2];
+
+    MemoryTracker() : totals(), peaks() { }
+};
+
+static MemoryTracker& tracker() {
+    static MemoryTracker memory_tracker;
+    return memory_tracker;
+}
+
+/* Returns the category, creating it empty the first time. The tracker's mutex must be held. */
+static MemoryCategory& find_category(MemoryTracker& memory_tracker, MemoryDomain domain, const std::string& name) {
+    std::pair<int, std::string> key((int)domain, name);
+    std::map<std::pair<int, std::string>, MemoryCategory>::iterator found = memory_tracker.categories.find(key);
+    if (found == memory_tracker.categories.end()) {
+        MemoryCategory category = { domain, name, 0, 0 };
+        found = memory_tracker.categories.insert(std::make_pair(key, category)).first;
+    }
+    return found->second;
+}
+
+/* Changes a category to new_bytes, keeping the domain total and the high-water marks up to date */
+static void change_category(MemoryTracker& memory_tracker, MemoryCategory& category, uint64_t new_bytes) {
+    uint64_t& total = memory_tracker.totals[category.domain];
+    total = total - category.bytes + new_bytes;
+    category.bytes = new_bytes;
+
+    category.peakBytes = std::max(category.peakBytes, category.bytes);
+    memory_tracker.peaks[category.domain] = std::max(memory_tracker.peaks[category.domain], total);
+}
+
+
+void memoryTrack(MemoryDomain domain, const std::string& category, int64_t bytes) {
+    MemoryTracker& memory_tracker = tracker();
+    std::lock_guard<std::mutex> lock(memory_tracker.mutex);
+
+    MemoryCategory& entry = find_category(memory_tracker, domain, category);
+    uint64_t removed = (bytes < 0) ? std::min<uint64_t>((uint64_t)(-bytes), entry.bytes) : 0;
+    change_category(memory_tracker, entry, (bytes < 0) ? entry.bytes - removed : entry.bytes + (uint64_t)bytes);
+}
+
+void memorySet(MemoryDomain domain, const std::string& category, uint64_t bytes) {
+    MemoryTracker& memory_tracker = tracker();
+    std::lock_guard<std::mutex> lock(memory_tracker.mutex);
+
+    change_category(memory_tracker, find_category(memory_tracker, domain, category), bytes);
+}
+
+void memoryTrackTransient(MemoryDomain domain, const std::string& category, uint64_t bytes) {
+    MemoryTracker& memory_tracker = tracker();
+    std::lock_guard<std::mutex> lock(memory_tracker.mutex);
+
+    MemoryCategory& entry = find_category(memory_tracker, domain, category);
+    uint64_t held = entry.bytes;
+    change_category(memory_tracker, entry, held + bytes);
+    change_category(memory_tracker, entry, held);
+}
+
+uint64_t memoryTotal(MemoryDomain domain) {
+    MemoryTracker& memory_tracker = tracker();
+    std::lock_guard<std::mutex> lock(memory_tracker.mutex);
+    return memory_tracker.totals[domain];
+}
+
+uint64_t memoryPeak(MemoryDomain domain) {
+    MemoryTracker& memory_tracker = tracker();
+    std::lock_guard<std::mutex> lock(memory_tracker.mutex);
+    return memory_tracker.peaks[domain];
+}
+
+std::vector<MemoryCategory> memoryCategories() {
+    MemoryTracker& memory_tracker = tracker();
+    std::lock_guard<std::mutex> lock(memory_tracker.mutex);
+
+    std::vector<MemoryCategory> categories;
+    for (const std::pair<const std::pair<int, std::string>, MemoryCategory>& entry : memory_tracker.categories) {
+        categories.push_back(entry.second);
+    }
+    return categories;
+}
+
+/* Bytes in kibibytes, as the report shows them */
+static double kilobytes(uint64_t bytes) {
+    return bytes / 1024.0;
+}
+
+void memoryPrintReport(FILE* file) {
+    std::vector<MemoryCategory> categories = memoryCategories();
+    const char* domain_names[] = { "CPU", "GPU" };
+
+    for (int domain = MEMORY_CPU; domain <= MEMORY_GPU; domain++) {
+        fprintf(file, "Memory %s: %.1f KB, peak %.1f KB\n", domain_names[domain],
+                kilobytes(memoryTotal((MemoryDomain)domain)), kilobytes(memoryPeak((MemoryDomain)domain)));
+        for (const MemoryCategory& category : categories) {
+            if (category.domain == domain) {
+                fprintf(file, "    %-32s %10.1f KB, peak %10.1f KB\n", category.name.c_str(),
+                        kilobytes(category.bytes), kilobytes(category.peakBytes));
+            }
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef MEMORY_TRACKER_HPP
+#define MEMORY_TRACKER_HPP
+#pragma once
+
+
+// System headers
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+// Where tracked memory lives
+enum MemoryDomain {
+    MEMORY_CPU,
+    MEMORY_GPU
+};
+
+// Bytes attributed to one category, e.g. "mesh/Body_body" or "renderer/instance buffer". Categories do not overlap,
+// so the bytes of all categories of a domain add up to the domain's total.
+struct MemoryCategory {
+    MemoryDomain domain;
+    std::string name;
+    uint64_t bytes;
+    uint64_t peakBytes;
+};
+
+
+// Adds bytes to a category, or removes them if bytes is negative. Thread safe, as are all functions below.
+void memoryTrack(MemoryDomain domain, const std::string& category, int64_t bytes);
+
+// Sets the bytes of a category, e.g. to the capacity of a buffer that has grown
+void memorySet(MemoryDomain domain, const std::string& category, uint64_t bytes);
+
+// Counts bytes that are held only briefly, e.g. loader scratch, in the high-water marks of the category and domain
+void memoryTrackTransient(MemoryDomain domain, const std::string& category, uint64_t bytes);
+
+// Bytes of a domain now and at its high-water mark
+uint64_t memoryTotal(MemoryDomain domain);
+uint64_t memoryPeak(MemoryDomain domain);
+
+// Every category, CPU before GPU and by name within a domain
+std::vector<MemoryCategory> memoryCategories();
+
+// Prints the totals and every category
+void memoryPrintReport(FILE* file);
+
+
+#endif
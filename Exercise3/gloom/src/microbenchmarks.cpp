@@ -0,0 +1,367 @@
+#include "microbenchmarks.hpp"
+
+// System headers
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+
+// Local headers
+#include "bvh.hpp"
+#include "program.hpp"
+#include "sceneGraph.hpp"
+#include "transformMath.hpp"
+#include "toolbox.hpp"
+
+
+/* The local transformation as it was built by update_translation_matrix and update_rotation_matrix,
+   kept here as the baseline the fused version is measured against */
+static glm::mat4 compose_with_glm(glm::vec3 position, glm::vec3 rotation, glm::vec3 reference) {
+    glm::mat4 translation = glm::translate(position);
+
+    glm::mat4 translate_to_origin = glm::translate(-reference);
+    glm::mat4 rotation_x = glm::rotate(rotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
+    glm::mat4 rotation_y = glm::rotate(rotation.y, glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 rotation_z = glm::rotate(rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::mat4 translate_from_origin = glm::translate(reference);
+
+    return translation * (translate_from_origin * rotation_x * rotation_y * rotation_z * translate_to_origin);
+}
+
+/* Largest absolute difference between two sets of matrices */
+static float max_difference(const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b) {
+    float difference = 0.0f;
+
+    for (size_t i = 0; i < a.size(); i++) {
+        for (int column = 0; column < 4; column++) {
+            for (int row = 0; row < 4; row++) {
+                difference = std::fmax(difference, std::fabs(a[i][column][row] - b[i][column][row]));
+            }
+        }
+    }
+    return difference;
+}
+
+/* Sums every entry so the compiler cannot discard the benchmarked work */
+static float checksum(const std::vector<glm::mat4>& matrices) {
+    float sum = 0.0f;
+
+    for (const glm::mat4& matrix : matrices) {
+        sum += matrix[3][0] + matrix[3][1] + matrix[3][2] + matrix[0][0];
+    }
+    return sum;
+}
+
+static double nanoseconds_per_node(std::chrono::steady_clock::time_point start, unsigned int nodeCount, unsigned int iterations) {
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    double nanoseconds = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    return nanoseconds / ((double)nodeCount * (double)iterations);
+}
+
+void runTransformMicrobenchmark(unsigned int nodeCount, unsigned int iterations) {
+    std::vector<glm::vec3> positions(nodeCount);
+    std::vector<glm::vec3> rotations(nodeCount);
+    std::vector<glm::vec3> references(nodeCount);
+    std::vector<glm::mat4> parents(nodeCount);
+
+    for (unsigned int i = 0; i < nodeCount; i++) {
+        positions[i] = glm::vec3(randomUniformFloat(), randomUniformFloat(), randomUniformFloat()) * 100.0f;
+        rotations[i] = glm::vec3(randomUniformFloat(), randomUniformFloat(), randomUniformFloat()) * 6.28f;
+        references[i] = glm::vec3(randomUniformFloat(), randomUniformFloat(), randomUniformFloat()) * 10.0f;
+        parents[i] = compose_with_glm(positions[i] * 0.5f, rotations[i] * 0.5f, glm::vec3(0.0f));
+    }
+
+    std::vector<glm::mat4> glm_results(nodeCount);
+    std::vector<glm::mat4> fused_results(nodeCount);
+    std::vector<glm::mat4> batch_results(nodeCount);
+    std::vector<glm::mat4> locals(nodeCount);
+    float sum = 0.0f;
+
+    // Original path: five matrices per local transformation, then parent * translation * rotation
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int iteration = 0; iteration < iterations; iteration++) {
+        for (unsigned int i = 0; i < nodeCount; i++) {
+            glm_results[i] = parents[i] * compose_with_glm(positions[i], rotations[i], references[i]);
+        }
+        sum += checksum(glm_results);
+    }
+    double glm_cost = nanoseconds_per_node(start, nodeCount, iterations);
+
+    // Fused construction and a single SIMD multiply per node
+    start = std::chrono::steady_clock::now();
+    for (unsigned int iteration = 0; iteration < iterations; iteration++) {
+        for (unsigned int i = 0; i < nodeCount; i++) {
+            fused_results[i] = multiplyTransform(parents[i], composeEulerTransform(positions[i], rotations[i], references[i]));
+        }
+        sum += checksum(fused_results);
+    }
+    double fused_cost = nanoseconds_per_node(start, nodeCount, iterations);
+
+    // Fused construction into an array followed by the batch kernel
+    start = std::chrono::steady_clock::now();
+    for (unsigned int iteration = 0; iteration < iterations; iteration++) {
+        composeEulerTransforms(positions.data(), rotations.data(), references.data(), locals.data(), nodeCount);
+        multiplyTransforms(parents.data(), locals.data(), batch_results.data(), nodeCount);
+        sum += checksum(batch_results);
+    }
+    double batch_cost = nanoseconds_per_node(start, nodeCount, iterations);
+
+    printf("Transform microbenchmark (%u nodes, %u iterations)\n", nodeCount, iterations);
+    printf("    glm translate/rotate path:  %8.2f ns/node\n", glm_cost);
+    printf("    fused + SIMD multiply:      %8.2f ns/node (%.2fx)\n", fused_cost, glm_cost / fused_cost);
+    printf("    fused + SIMD batch kernel:  %8.2f ns/node (%.2fx)\n", batch_cost, glm_cost / batch_cost);
+    printf("    max difference to glm: %g (fused), %g (batch)\n",
+           max_difference(glm_results, fused_results), max_difference(glm_results, batch_results));
+    printf("    checksum: %f\n", sum);
+}
+
+
+static double milliseconds_since(std::chrono::steady_clock::time_point start) {
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() * 1e-6;
+}
+
+/* Moves a node's world bounds the way update_scene_node does when its transformation changes */
+static void move_node(SceneNode* node, glm::vec3 position) {
+    node->position = position;
+    node->currentTransformationMatrix = glm::translate(position);
+    node->worldBounds = transformAABB(node->localBounds, node->currentTransformationMatrix);
+    node->transformVersion++;
+}
+
+void runBVHMicrobenchmark(unsigned int frames) {
+    const unsigned int node_counts[] = { 1000, 10000, 100000 };
+    const float world_size = 2000.0f;
+
+    printf("BVH microbenchmark (%u frames, 10%% of the nodes moving per frame)\n", frames);
+
+    for (unsigned int node_count : node_counts) {
+        SceneNode* root = createSceneNode();
+        std::vector<SceneNode*> nodes(node_count);
+
+        for (unsigned int i = 0; i < node_count; i++) {
+            nodes[i] = createSceneNode();
+            nodes[i]->localBounds = AABB(glm::vec3(-2.0f), glm::vec3(2.0f));
+            addChild(root, nodes[i]);
+            move_node(nodes[i], glm::vec3(randomUniformFloat(), randomUniformFloat(), randomUniformFloat()) * world_size);
+        }
+
+        BVH bvh;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bvh.build(root);
+        double build_time = milliseconds_since(start);
+        float build_cost = bvh.cost();
+
+        // Every frame a tenth of the nodes take a small step, so the tree is refitted rather than rebuilt
+        unsigned int moving = node_count / 10;
+        start = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < frames; frame++) {
+            for (unsigned int i = 0; i < moving; i++) {
+                SceneNode* node = nodes[(frame * moving + i) % node_count];
+                glm::vec3 step = glm::vec3(randomUniformFloat(), randomUniformFloat(), randomUniformFloat()) - 0.5f;
+                move_node(node, node->position + step * 4.0f);
+            }
+            bvh.update();
+        }
+        double update_time = milliseconds_since(start) / frames;
+
+        // Queries against the tree and against every node
+        glm::mat4 view_projection = glm::perspective(glm::radians(70.0f), 1.33f, 1.0f, 500.0f)
+            * glm::lookAt(glm::vec3(world_size * 0.5f), glm::vec3(world_size * 0.5f, world_size * 0.5f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        Gloom::Frustum frustum = Gloom::extractFrustum(view_projection);
+        glm::vec3 center(world_size * 0.5f);
+        float radius = world_size * 0.1f;
+        glm::vec3 direction = glm::normalize(glm::vec3(1.0f, 0.7f, 0.3f));
+
+        std::vector<SceneNode*> results;
+        size_t tree_hits = 0;
+        start = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < frames; frame++) {
+            results.clear();
+            bvh.queryFrustum(frustum, results);
+            bvh.querySphere(center, radius, results);
+            bvh.queryRay(glm::vec3(0.0f), direction, world_size * 2.0f, results);
+            tree_hits += results.size();
+        }
+        double tree_query_time = milliseconds_since(start) / frames;
+
+        size_t brute_force_hits = 0;
+        start = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < frames; frame++) {
+            for (SceneNode* node : nodes) {
+                glm::vec3 closest = glm::clamp(center, node->worldBounds.min, node->worldBounds.max) - center;
+                glm::vec3 t0 = node->worldBounds.min / direction;
+                glm::vec3 t1 = node->worldBounds.max / direction;
+                glm::vec3 near = glm::min(t0, t1);
+                glm::vec3 far = glm::max(t0, t1);
+                float entry = std::fmax(std::fmax(near.x, near.y), std::fmax(near.z, 0.0f));
+                float exit = std::fmin(std::fmin(far.x, far.y), std::fmin(far.z, world_size * 2.0f));
+
+                brute_force_hits += intersectsFrustum(frustum, node->worldBounds) ? 1 : 0;
+                brute_force_hits += (glm::dot(closest, closest) <= radius * radius) ? 1 : 0;
+                brute_force_hits += (entry <= exit) ? 1 : 0;
+            }
+        }
+        double brute_force_time = milliseconds_since(start) / frames;
+
+        printf("    %6u nodes: build %7.3f ms, refit %7.4f ms/frame, cost %.1f -> %.1f, %u rebuilds\n",
+               node_count, build_time, update_time, build_cost, bvh.cost(), bvh.rebuildCount());
+        printf("                  frustum + sphere + ray queries %7.4f ms, testing every node %7.4f ms (%.1fx), hits %s\n",
+               tree_query_time, brute_force_time, brute_force_time / tree_query_time,
+               (tree_hits == brute_force_hits) ? "match" : "DIFFER");
+
+        destroySceneNode(root);
+    }
+
+    // Nodes spaced exponentially along x, from 1e-30 to 1e29: every SAH split only peels off the farthest few nodes,
+    // so without the depth limit the tree gets deeper than the traversal stacks of the queries
+    const unsigned int skewed_count = 2800;
+    SceneNode* root = createSceneNode();
+    std::vector<SceneNode*> nodes(skewed_count);
+    for (unsigned int i = 0; i < skewed_count; i++) {
+        nodes[i] = createSceneNode();
+        nodes[i]->localBounds = AABB(glm::vec3(-1e-31f), glm::vec3(1e-31f));
+        addChild(root, nodes[i]);
+        move_node(nodes[i], glm::vec3((float)(1e-30 * std::pow(1.05, (double)i)), 0.0f, 0.0f));
+    }
+
+    BVH bvh;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bvh.build(root);
+    double build_time = milliseconds_since(start);
+
+    // Every node is found by a point query at its position, and all of them by a ray along x
+    std::vector<SceneNode*> results;
+    unsigned int found = 0;
+    start = std::chrono::steady_clock::now();
+    for (SceneNode* node : nodes) {
+        results.clear();
+        bvh.querySphere(node->position, 0.0f, results);
+        found += (std::find(results.begin(), results.end(), node) != results.end()) ? 1 : 0;
+    }
+    results.clear();
+    bvh.queryRay(glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 1e38f, results);
+    double query_time = milliseconds_since(start);
+
+    printf("    %6u nodes spaced exponentially: build %7.3f ms, depth %u, %u sphere queries + 1 ray %7.4f ms, hits %s\n",
+           skewed_count, build_time, bvh.depth(), skewed_count, query_time,
+           (found == skewed_count && results.size() == skewed_count) ? "match" : "DIFFER");
+
+    destroySceneNode(root);
+}
+
+
+/* Largest difference between a node's world matrix and its parent's world matrix times its own local transformation */
+static float world_matrix_error(const SceneNode* node) {
+    glm::mat4 expected = multiplyTransform(node->parent->currentTransformationMatrix,
+                                           composeEulerTransform(node->position, node->rotation, node->referencePoint));
+    float error = 0.0f;
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            error = std::fmax(error, std::fabs(expected[column][row] - node->currentTransformationMatrix[column][row]));
+        }
+    }
+    return error;
+}
+
+void runSpawnMicrobenchmark(unsigned int helicopterCount, unsigned int frames) {
+    const unsigned int route_count = 16;
+    const double tick = 1.0 / 60.0;
+
+    // Only the bounds of the parts matter here, nothing is drawn
+    ModelPart part = { 0, 0, 0, AABB(glm::vec3(-1.0f), glm::vec3(1.0f)) };
+    HelicopterParts parts = { part, part, part, part };
+
+    // The helicopters are spawned below a static node that is up to date before the first of them arrives
+    SceneNode* root = createSceneNode();
+    SceneNode* terrain = createSceneNode();
+    addChild(root, terrain);
+    setNodePosition(terrain, glm::vec3(0.0f, -20.0f, 0.0f));
+    update_scene_node(root, glm::mat4(1.0f), false, nullptr);
+
+    SceneAnimation animation;
+    for (unsigned int route = 0; route < route_count; route++) {
+        animation.paths.addPath(createLissajousRoute(route * 0.4f, 1.0f + 0.05f * route));
+    }
+
+    // Oldest helicopter first. Every frame the oldest turnover helicopters are despawned and as many are spawned,
+    // so at 60 frames per second about every helicopter is replaced once a second.
+    std::deque<SceneNode*> helicopters;
+    unsigned int spawned = 0;
+    for (; spawned < helicopterCount; spawned++) {
+        helicopters.push_back(spawn_helicopter(terrain, parts, animation, spawned % route_count, (float)spawned));
+    }
+    unsigned int turnover = std::max(helicopterCount / 60, 1u);
+
+    ThreadPool pool;
+    std::vector<SceneNodeHandle> despawned;
+    size_t stale_handles = 0;
+    float largest_error = 0.0f;
+    size_t warm_capacity = 0;
+    double spawn_time = 0.0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (unsigned int frame = 0; frame < frames; frame++) {
+        std::chrono::steady_clock::time_point spawn_start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < turnover; i++) {
+            helicopters.push_back(spawn_helicopter(terrain, parts, animation, spawned % route_count, (float)spawned));
+            spawned++;
+        }
+
+        // The static node is clean since the last update, so only spawning can lead the update to the new helicopters.
+        // Checked before despawning or moving any helicopter, as either flags the static node as well.
+        update_scene_node(root, glm::mat4(1.0f), false, &pool);
+        for (size_t i = helicopters.size() - turnover; i < helicopters.size(); i++) {
+            largest_error = std::fmax(largest_error, world_matrix_error(helicopters[i]));
+            for (const SceneNode* child : helicopters[i]->children) {
+                largest_error = std::fmax(largest_error, world_matrix_error(child));
+            }
+        }
+
+        despawned.clear();
+        for (unsigned int i = 0; i < turnover; i++) {
+            SceneNode* body = helicopters.front();
+            helicopters.pop_front();
+            despawned.push_back(getSceneNodeHandle(body));
+            despawned.push_back(getSceneNodeHandle(body->children[0]));
+            despawn_helicopter(body);
+        }
+        spawn_time += milliseconds_since(spawn_start);
+
+        // Handles to despawned nodes must not resolve, even once their slots hold new helicopters
+        for (SceneNodeHandle handle : despawned) {
+            stale_handles += (resolveSceneNode(handle) != nullptr) ? 1 : 0;
+        }
+
+        double time = frame * tick;
+        animation.channels.evaluate(time);
+        animation.paths.evaluate(time, &pool);
+        animation.channels.apply();
+        animation.paths.apply(&pool);
+        update_scene_node(root, glm::mat4(1.0f), false, &pool);
+
+        if (frame == 0) {
+            warm_capacity = getSceneNodeCapacity();
+        }
+    }
+    double frame_time = milliseconds_since(start) / frames;
+
+    printf("Spawn microbenchmark (%u helicopters, %u despawned and spawned per frame, %u frames)\n",
+           helicopterCount, turnover, frames);
+    printf("    spawn + despawn + placing %7.4f ms/frame, with animation and transform update %7.4f ms/frame\n",
+           spawn_time / frames, frame_time);
+    printf("    node pool: %zu live, capacity %zu after the first frame, %zu at the end\n",
+           getLiveSceneNodeCount(), warm_capacity, getSceneNodeCapacity());
+    printf("    largest world matrix error of spawned nodes %g, stale handles resolving %zu: %s\n",
+           largest_error, stale_handles, (largest_error < 1e-3f && stale_handles == 0) ? "ok" : "FAILED");
+
+    destroySceneNode(root);
+}
@@ -0,0 +1,23 @@
+#ifndef MICROBENCHMARKS_HPP
+#define MICROBENCHMARKS_HPP
+#pragma once
+
+
+// CPU-only benchmarks that can be run without opening a window.
+// Results are printed to stdout.
+
+// Compares building and propagating node transforms through the original glm path
+// against the fused construction and SIMD kernels in transformMath.hpp
+void runTransformMicrobenchmark(unsigned int nodeCount = 10000, unsigned int iterations = 200);
+
+// Measures building, refitting and querying the BVH in bvh.hpp at 1k, 10k and 100k nodes,
+// with a tenth of the nodes moving every frame, and compares queries against testing every node.
+// Also builds and queries a degenerate scene of nodes spaced exponentially along one axis.
+void runBVHMicrobenchmark(unsigned int frames = 100);
+
+// Despawns the oldest helicopters and spawns new ones below a static node every frame, replacing all of them once
+// a second, and checks that new helicopters are placed correctly and that handles to despawned ones stop resolving
+void runSpawnMicrobenchmark(unsigned int helicopterCount = 1000, unsigned int frames = 300);
+
+
+#endif
@@ -0,0 +1,520 @@
+#include "occlusion.hpp"
+#include "simd.hpp"
+#include "profiler.hpp"
+#include "memoryTracker.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <cmath>
+
+// Size of the tiles the buffer is split into. Every tile is rasterised by one task.
+// The tile width has to be a multiple of four, as rows are processed four pixels at a time.
+#define OCCLUSION_TILE_WIDTH 64
+#define OCCLUSION_TILE_HEIGHT 32
+
+// Triangles set up and binned by one task
+#define OCCLUSION_TRIANGLES_PER_CHUNK 512
+
+// Vertices transformed by one task
+#define OCCLUSION_VERTEX_GRAIN_SIZE 1024
+
+// Depth of a pixel no occluder has been drawn to
+#define OCCLUSION_FAR_DEPTH 1.0f
+
+
+OccluderMesh createTerrainOccluder(const Mesh& terrain, unsigned int gridSize) {
+    OccluderMesh occluder;
+    AABB bounds = computeMeshBounds(terrain);
+    if (isEmpty(bounds) || gridSize == 0) {
+        return occluder;
+    }
+
+    float cell_width = (bounds.max.x - bounds.min.x) / gridSize;
+    float cell_depth = (bounds.max.z - bounds.min.z) / gridSize;
+    if (cell_width <= 0.0f || cell_depth <= 0.0f) {
+        return occluder;
+    }
+
+    // Lowest height of every triangle touching a cell. Taking whole triangles rather than vertices
+    // also covers triangles that pass through a cell without having a vertex in it.
+    std::vector<float> cell_height(gridSize * gridSize, 1e30f);
+
+    for (size_t i = 0; i + 2 < terrain.indices.size(); i += 3) {
+        glm::vec3 corners[3];
+        for (int j = 0; j < 3; j++) {
+            const float* vertex = &terrain.vertices[3 * terrain.indices[i + j]];
+            corners[j] = glm::vec3(vertex[0], vertex[1], vertex[2]);
+        }
+        glm::vec3 low = glm::min(corners[0], glm::min(corners[1], corners[2]));
+        glm::vec3 high = glm::max(corners[0], glm::max(corners[1], corners[2]));
+
+        int first_x = std::max((int)((low.x - bounds.min.x) / cell_width), 0);
+        int last_x = std::min((int)((high.x - bounds.min.x) / cell_width), (int)gridSize - 1);
+        int first_z = std::max((int)((low.z - bounds.min.z) / cell_depth), 0);
+        int last_z = std::min((int)((high.z - bounds.min.z) / cell_depth), (int)gridSize - 1);
+
+        for (int z = first_z; z <= last_z; z++) {
+            for (int x = first_x; x <= last_x; x++) {
+                float& height = cell_height[z * gridSize + x];
+                height = std::min(height, low.y);
+            }
+        }
+    }
+
+    // A grid corner takes the lowest height of the cells around it, so every cell's triangles stay below its height
+    unsigned int corner_count = gridSize + 1;
+    for (unsigned int z = 0; z < corner_count; z++) {
+        for (unsigned int x = 0; x < corner_count; x++) {
+            float height = 1e30f;
+            for (unsigned int cell_z = (z > 0 ? z - 1 : 0); cell_z <= std::min(z, gridSize - 1); cell_z++) {
+                for (unsigned int cell_x = (x > 0 ? x - 1 : 0); cell_x <= std::min(x, gridSize - 1); cell_x++) {
+                    height = std::min(height, cell_height[cell_z * gridSize + cell_x]);
+                }
+            }
+            occluder.vertices.push_back(glm::vec3(bounds.min.x + x * cell_width, height, bounds.min.z + z * cell_depth));
+        }
+    }
+
+    // Two triangles per cell the terrain covers, counter-clockwise seen from above
+    for (unsigned int z = 0; z < gridSize; z++) {
+        for (unsigned int x = 0; x < gridSize; x++) {
+            if (cell_height[z * gridSize + x] >= 1e30f) {
+                continue;
+            }
+            unsigned int corner = z * corner_count + x;
+
+            occluder.indices.push_back(corner);
+            occluder.indices.push_back(corner + corner_count);
+            occluder.indices.push_back(corner + 1);
+
+            occluder.indices.push_back(corner + 1);
+            occluder.indices.push_back(corner + corner_count);
+            occluder.indices.push_back(corner + corner_count + 1);
+        }
+    }
+    return occluder;
+}
+
+
+/* Bytes of the vertices and indices of an occluder mesh */
+static uint64_t occluder_bytes(const OccluderMesh& mesh) {
+    return (uint64_t)mesh.vertices.size() * sizeof(glm::vec3) + (uint64_t)mesh.indices.size() * sizeof(unsigned int);
+}
+
+
+OcclusionBuffer::OcclusionBuffer(unsigned int width, unsigned int height)
+    : viewProjection(1.0f), triangleCount(0), renderTime(0.0) {
+    tilesX = std::max((width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH, 1u);
+    tilesY = std::max((height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT, 1u);
+    bufferWidth = tilesX * OCCLUSION_TILE_WIDTH;
+    bufferHeight = tilesY * OCCLUSION_TILE_HEIGHT;
+
+    depth.assign(bufferWidth * bufferHeight, OCCLUSION_FAR_DEPTH);
+    tileMaxDepth.assign(tilesX * tilesY, OCCLUSION_FAR_DEPTH);
+    memoryTrack(MEMORY_CPU, "occlusion/depth buffer", (int64_t)((depth.size() + tileMaxDepth.size()) * sizeof(float)));
+}
+
+OcclusionBuffer::~OcclusionBuffer() {
+    memoryTrack(MEMORY_CPU, "occlusion/depth buffer", -(int64_t)((depth.size() + tileMaxDepth.size()) * sizeof(float)));
+    for (const Occluder& occluder : occluders) {
+        memoryTrack(MEMORY_CPU, "occlusion/occluder meshes", -(int64_t)occluder_bytes(occluder.mesh));
+    }
+}
+
+void OcclusionBuffer::addOccluder(const OccluderMesh& mesh, SceneNode* node) {
+    Occluder occluder;
+    occluder.mesh = mesh;
+    occluder.node = getSceneNodeHandle(node);
+    occluders.push_back(occluder);
+    memoryTrack(MEMORY_CPU, "occlusion/occluder meshes", (int64_t)occluder_bytes(mesh));
+}
+
+void OcclusionBuffer::captureTransforms(OccluderTransforms& transforms) const {
+    transforms.matrices.resize(occluders.size());
+    transforms.present.resize(occluders.size());
+
+    for (size_t i = 0; i < occluders.size(); i++) {
+        SceneNode* node = resolveSceneNode(occluders[i].node);
+        transforms.present[i] = (node != nullptr) ? 1 : 0;
+        transforms.matrices[i] = (node != nullptr) ? node->currentTransformationMatrix : glm::mat4(1.0f);
+    }
+}
+
+void OcclusionBuffer::render(const glm::mat4& viewProjection, ThreadPool* pool) {
+    OccluderTransforms transforms;
+    captureTransforms(transforms);
+    render(viewProjection, transforms, pool);
+}
+
+void OcclusionBuffer::render(const glm::mat4& viewProjection, const OccluderTransforms& transforms, ThreadPool* pool) {
+    PROFILE_ZONE("Occlusion buffer");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    this->viewProjection = viewProjection;
+
+    // Gather the occluders into one clip space vertex array
+    clipVertices.clear();
+    clipIndices.clear();
+    for (size_t i = 0; i < occluders.size() && i < transforms.matrices.size(); i++) {
+        if (!transforms.present[i]) {
+            continue;
+        }
+        const Occluder& occluder = occluders[i];
+        unsigned int base = (unsigned int)clipVertices.size();
+        glm::mat4 transform = viewProjection * transforms.matrices[i];
+
+        clipVertices.resize(base + occluder.mesh.vertices.size());
+        const glm::vec3* source = occluder.mesh.vertices.data();
+        glm::vec4* destination = clipVertices.data() + base;
+
+        std::function<void(size_t, size_t)> transform_range = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                destination[i] = transform * glm::vec4(source[i], 1.0f);
+            }
+        };
+        if (pool != nullptr) {
+            pool->parallelFor(occluder.mesh.vertices.size(), OCCLUSION_VERTEX_GRAIN_SIZE, transform_range);
+        } else {
+            transform_range(0, occluder.mesh.vertices.size());
+        }
+
+        for (unsigned int index : occluder.mesh.indices) {
+            clipIndices.push_back(base + index);
+        }
+    }
+
+    // Set up and bin the triangles in chunks, every chunk with its own bins so that no task waits for another
+    size_t triangle_total = clipIndices.size() / 3;
+    size_t chunk_count = (triangle_total + OCCLUSION_TRIANGLES_PER_CHUNK - 1) / OCCLUSION_TRIANGLES_PER_CHUNK;
+    if (chunks.size() < chunk_count) {
+        chunks.resize(chunk_count);
+    }
+
+    std::function<void(size_t, size_t)> setup_range = [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; chunk++) {
+            size_t first = chunk * OCCLUSION_TRIANGLES_PER_CHUNK;
+            setupTriangles(chunk, first, std::min(first + OCCLUSION_TRIANGLES_PER_CHUNK, triangle_total));
+        }
+    };
+
+    // Each tile is cleared and rasterised by a single task
+    std::function<void(size_t, size_t)> rasterise_range = [&](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; tile++) {
+            rasteriseTile((unsigned int)tile);
+        }
+    };
+
+    // Chunks beyond this frame's count keep their memory but must not be rasterised
+    for (size_t chunk = chunk_count; chunk < chunks.size(); chunk++) {
+        chunks[chunk].triangles.clear();
+        for (std::vector<unsigned int>& bin : chunks[chunk].bins) {
+            bin.clear();
+        }
+    }
+
+    if (pool != nullptr) {
+        pool->parallelFor(chunk_count, 1, setup_range);
+        pool->parallelFor(tilesX * tilesY, 1, rasterise_range);
+    } else {
+        setup_range(0, chunk_count);
+        rasterise_range(0, tilesX * tilesY);
+    }
+
+    triangleCount = 0;
+    for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+        triangleCount += (unsigned int)chunks[chunk].triangles.size();
+    }
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    renderTime = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() * 1e-3;
+}
+
+/* Clips the triangles against the near plane, drops the ones facing away and bins the rest into the tiles they overlap */
+void OcclusionBuffer::setupTriangles(size_t chunk, size_t firstTriangle, size_t lastTriangle) {
+    TriangleChunk& target = chunks[chunk];
+    target.triangles.clear();
+    target.bins.resize(tilesX * tilesY);
+    for (std::vector<unsigned int>& bin : target.bins) {
+        bin.clear();
+    }
+
+    for (size_t triangle = firstTriangle; triangle < lastTriangle; triangle++) {
+        const glm::vec4 corners[3] = {
+            clipVertices[clipIndices[3 * triangle]],
+            clipVertices[clipIndices[3 * triangle + 1]],
+            clipVertices[clipIndices[3 * triangle + 2]]
+        };
+
+        // A point is in front of the near plane when z + w >= 0
+        float distances[3];
+        int inside_count = 0;
+        for (int i = 0; i < 3; i++) {
+            distances[i] = corners[i].z + corners[i].w;
+            inside_count += (distances[i] >= 0.0f) ? 1 : 0;
+        }
+
+        if (inside_count == 3) {
+            addTriangle(target, corners[0], corners[1], corners[2]);
+            continue;
+        }
+        if (inside_count == 0) {
+            continue;
+        }
+
+        // Sutherland-Hodgman against the near plane leaves a triangle or a quad
+        glm::vec4 polygon[4];
+        int polygon_size = 0;
+        for (int i = 0; i < 3; i++) {
+            int next = (i + 1) % 3;
+            if (distances[i] >= 0.0f) {
+                polygon[polygon_size++] = corners[i];
+            }
+            if ((distances[i] >= 0.0f) != (distances[next] >= 0.0f)) {
+                float t = distances[i] / (distances[i] - distances[next]);
+                polygon[polygon_size++] = corners[i] + t * (corners[next] - corners[i]);
+            }
+        }
+        for (int i = 1; i + 1 < polygon_size; i++) {
+            addTriangle(target, polygon[0], polygon[i], polygon[i + 1]);
+        }
+    }
+}
+
+void OcclusionBuffer::addTriangle(TriangleChunk& chunk, const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+    // Pixel coordinates, with y pointing up as in normalised device coordinates
+    glm::vec3 screen[3];
+    const glm::vec4* corners[3] = { &a, &b, &c };
+    for (int i = 0; i < 3; i++) {
+        float inverse_w = 1.0f / std::max(corners[i]->w, 1e-6f);
+        screen[i] = glm::vec3((corners[i]->x * inverse_w * 0.5f + 0.5f) * bufferWidth,
+                              (corners[i]->y * inverse_w * 0.5f + 0.5f) * bufferHeight,
+                              corners[i]->z * inverse_w);
+    }
+
+    // Twice the signed area. Counter-clockwise triangles face the camera.
+    float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y)
+               - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+    if (!(area > 0.0f)) {
+        return;
+    }
+
+    glm::vec3 low = glm::min(screen[0], glm::min(screen[1], screen[2]));
+    glm::vec3 high = glm::max(screen[0], glm::max(screen[1], screen[2]));
+
+    SetupTriangle triangle;
+    triangle.minX = std::max((int)std::floor(low.x), 0);
+    triangle.minY = std::max((int)std::floor(low.y), 0);
+    triangle.maxX = std::min((int)std::ceil(high.x), (int)bufferWidth - 1);
+    triangle.maxY = std::min((int)std::ceil(high.y), (int)bufferHeight - 1);
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+        return;
+    }
+
+    // Edge i runs between the other two corners and is positive on the inside, normalised to the barycentric weight of corner i
+    float inverse_area = 1.0f / area;
+    for (int i = 0; i < 3; i++) {
+        const glm::vec3& from = screen[(i + 1) % 3];
+        const glm::vec3& to = screen[(i + 2) % 3];
+        triangle.edgeA[i] = (from.y - to.y) * inverse_area;
+        triangle.edgeB[i] = (to.x - from.x) * inverse_area;
+        triangle.edgeC[i] = ((to.y - from.y) * from.x - (to.x - from.x) * from.y) * inverse_area;
+    }
+
+    // Depth is affine in screen space, so it is the barycentric weights applied to the corner depths
+    triangle.depthA = triangle.edgeA[0] * screen[0].z + triangle.edgeA[1] * screen[1].z + triangle.edgeA[2] * screen[2].z;
+    triangle.depthB = triangle.edgeB[0] * screen[0].z + triangle.edgeB[1] * screen[1].z + triangle.edgeB[2] * screen[2].z;
+    triangle.depthC = triangle.edgeC[0] * screen[0].z + triangle.edgeC[1] * screen[1].z + triangle.edgeC[2] * screen[2].z;
+
+    unsigned int index = (unsigned int)chunk.triangles.size();
+    chunk.triangles.push_back(triangle);
+
+    int first_tile_x = triangle.minX / OCCLUSION_TILE_WIDTH;
+    int last_tile_x = triangle.maxX / OCCLUSION_TILE_WIDTH;
+    int first_tile_y = triangle.minY / OCCLUSION_TILE_HEIGHT;
+    int last_tile_y = triangle.maxY / OCCLUSION_TILE_HEIGHT;
+    for (int tile_y = first_tile_y; tile_y <= last_tile_y; tile_y++) {
+        for (int tile_x = first_tile_x; tile_x <= last_tile_x; tile_x++) {
+            chunk.bins[tile_y * tilesX + tile_x].push_back(index);
+        }
+    }
+}
+
+/* Clears a tile and rasterises every triangle binned into it, four pixels at a time with SSE where available.
+   The scalar loops cover the same groups of four pixels, so both give the same buffer. */
+void OcclusionBuffer::rasteriseTile(unsigned int tile) {
+    int tile_min_x = (tile % tilesX) * OCCLUSION_TILE_WIDTH;
+    int tile_min_y = (tile / tilesX) * OCCLUSION_TILE_HEIGHT;
+    int tile_max_x = tile_min_x + OCCLUSION_TILE_WIDTH - 1;
+    int tile_max_y = tile_min_y + OCCLUSION_TILE_HEIGHT - 1;
+
+    for (int y = tile_min_y; y <= tile_max_y; y++) {
+        std::fill(&depth[y * bufferWidth + tile_min_x], &depth[y * bufferWidth + tile_min_x] + OCCLUSION_TILE_WIDTH, OCCLUSION_FAR_DEPTH);
+    }
+
+#if defined(SIMD_SSE)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 lane_offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+#endif
+
+    for (const TriangleChunk& chunk : chunks) {
+        if (chunk.bins.empty()) {
+            continue;
+        }
+        for (unsigned int index : chunk.bins[tile]) {
+            const SetupTriangle& triangle = chunk.triangles[index];
+
+            // Start at a multiple of four so that every group of pixels is aligned
+            int min_x = std::max(triangle.minX, tile_min_x) & ~3;
+            int max_x = std::min(triangle.maxX, tile_max_x);
+            int min_y = std::max(triangle.minY, tile_min_y);
+            int max_y = std::min(triangle.maxY, tile_max_y);
+
+#if defined(SIMD_SSE)
+            __m128 edge_a0 = _mm_set1_ps(triangle.edgeA[0]);
+            __m128 edge_a1 = _mm_set1_ps(triangle.edgeA[1]);
+            __m128 edge_a2 = _mm_set1_ps(triangle.edgeA[2]);
+            __m128 depth_a = _mm_set1_ps(triangle.depthA);
+
+            for (int y = min_y; y <= max_y; y++) {
+                float center_y = (float)y + 0.5f;
+                __m128 x = _mm_add_ps(_mm_set1_ps((float)min_x), lane_offsets);
+
+                __m128 row0 = _mm_set1_ps(triangle.edgeB[0] * center_y + triangle.edgeC[0]);
+                __m128 row1 = _mm_set1_ps(triangle.edgeB[1] * center_y + triangle.edgeC[1]);
+                __m128 row2 = _mm_set1_ps(triangle.edgeB[2] * center_y + triangle.edgeC[2]);
+                __m128 row_depth = _mm_set1_ps(triangle.depthB * center_y + triangle.depthC);
+
+                float* row = &depth[y * bufferWidth];
+                for (int group = min_x; group <= max_x; group += 4) {
+                    __m128 weight0 = _mm_add_ps(_mm_mul_ps(edge_a0, x), row0);
+                    __m128 weight1 = _mm_add_ps(_mm_mul_ps(edge_a1, x), row1);
+                    __m128 weight2 = _mm_add_ps(_mm_mul_ps(edge_a2, x), row2);
+
+                    __m128 inside = _mm_and_ps(_mm_cmpge_ps(weight0, zero),
+                                               _mm_and_ps(_mm_cmpge_ps(weight1, zero), _mm_cmpge_ps(weight2, zero)));
+                    if (_mm_movemask_ps(inside) != 0) {
+                        __m128 pixel_depth = _mm_add_ps(_mm_mul_ps(depth_a, x), row_depth);
+                        __m128 current = _mm_loadu_ps(row + group);
+                        __m128 closer = _mm_min_ps(current, pixel_depth);
+                        _mm_storeu_ps(row + group, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, current)));
+                    }
+                    x = _mm_add_ps(x, _mm_set1_ps(4.0f));
+                }
+            }
+#else
+            for (int y = min_y; y <= max_y; y++) {
+                float center_y = (float)y + 0.5f;
+                float row0 = triangle.edgeB[0] * center_y + triangle.edgeC[0];
+                float row1 = triangle.edgeB[1] * center_y + triangle.edgeC[1];
+                float row2 = triangle.edgeB[2] * center_y + triangle.edgeC[2];
+                float row_depth = triangle.depthB * center_y + triangle.depthC;
+
+                // Up to the end of the last group of four, which stays within the tile
+                float* row = &depth[y * bufferWidth];
+                for (int x = min_x; x <= (max_x | 3); x++) {
+                    float center_x = (float)x + 0.5f;
+                    if (triangle.edgeA[0] * center_x + row0 >= 0.0f && triangle.edgeA[1] * center_x + row1 >= 0.0f &&
+                        triangle.edgeA[2] * center_x + row2 >= 0.0f) {
+                        row[x] = std::min(row[x], triangle.depthA * center_x + row_depth);
+                    }
+                }
+            }
+#endif
+        }
+    }
+
+    // Farthest depth in the tile, so that boxes behind all of it are rejected without looking at pixels
+#if defined(SIMD_SSE)
+    __m128 farthest = _mm_setzero_ps();
+    for (int y = tile_min_y; y <= tile_max_y; y++) {
+        const float* row = &depth[y * bufferWidth];
+        for (int x = tile_min_x; x <= tile_max_x; x += 4) {
+            farthest = _mm_max_ps(farthest, _mm_loadu_ps(row + x));
+        }
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, farthest);
+    tileMaxDepth[tile] = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#else
+    float farthest = 0.0f;
+    for (int y = tile_min_y; y <= tile_max_y; y++) {
+        const float* row = &depth[y * bufferWidth];
+        farthest = std::max(farthest, *std::max_element(row + tile_min_x, row + tile_max_x + 1));
+    }
+    tileMaxDepth[tile] = farthest;
+#endif
+}
+
+bool OcclusionBuffer::isOccluded(const AABB& box) const {
+    if (isEmpty(box) || occluders.empty()) {
+        return false;
+    }
+
+    // Project the corners with the view projection the buffer was rendered with
+    float nearest = 1e30f;
+    glm::vec2 low(1e30f);
+    glm::vec2 high(-1e30f);
+
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec3 point((corner & 1) ? box.max.x : box.min.x,
+                        (corner & 2) ? box.max.y : box.min.y,
+                        (corner & 4) ? box.max.z : box.min.z);
+        glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+        if (clip.z + clip.w < 0.0f || clip.w <= 0.0f) {
+            return false;
+        }
+        float inverse_w = 1.0f / clip.w;
+        glm::vec2 pixel((clip.x * inverse_w * 0.5f + 0.5f) * bufferWidth, (clip.y * inverse_w * 0.5f + 0.5f) * bufferHeight);
+        low = glm::min(low, pixel);
+        high = glm::max(high, pixel);
+        nearest = std::min(nearest, clip.z * inverse_w);
+    }
+
+    int min_x = std::max((int)std::floor(low.x), 0);
+    int min_y = std::max((int)std::floor(low.y), 0);
+    int max_x = std::min((int)std::ceil(high.x), (int)bufferWidth - 1);
+    int max_y = std::min((int)std::ceil(high.y), (int)bufferHeight - 1);
+    if (min_x > max_x || min_y > max_y) {
+        return false;
+    }
+
+#if defined(SIMD_SSE)
+    __m128 box_depth = _mm_set1_ps(nearest);
+#endif
+    int first_tile_x = min_x / OCCLUSION_TILE_WIDTH;
+    int last_tile_x = max_x / OCCLUSION_TILE_WIDTH;
+    int first_tile_y = min_y / OCCLUSION_TILE_HEIGHT;
+    int last_tile_y = max_y / OCCLUSION_TILE_HEIGHT;
+
+    for (int tile_y = first_tile_y; tile_y <= last_tile_y; tile_y++) {
+        for (int tile_x = first_tile_x; tile_x <= last_tile_x; tile_x++) {
+            if (nearest > tileMaxDepth[tile_y * tilesX + tile_x]) {
+                continue;
+            }
+
+            // Somewhere in this tile the occluders are farther than the box, look at the pixels it covers
+            int from_x = std::max(min_x, tile_x * OCCLUSION_TILE_WIDTH) & ~3;
+            int to_x = std::min(max_x, tile_x * OCCLUSION_TILE_WIDTH + OCCLUSION_TILE_WIDTH - 1);
+            int from_y = std::max(min_y, tile_y * OCCLUSION_TILE_HEIGHT);
+            int to_y = std::min(max_y, tile_y * OCCLUSION_TILE_HEIGHT + OCCLUSION_TILE_HEIGHT - 1);
+
+            for (int y = from_y; y <= to_y; y++) {
+                const float* row = &depth[y * bufferWidth];
+#if defined(SIMD_SSE)
+                for (int x = from_x; x <= to_x; x += 4) {
+                    if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), box_depth)) != 0) {
+                        return false;
+                    }
+                }
+#else
+                for (int x = from_x; x <= (to_x | 3); x++) {
+                    if (row[x] >= nearest) {
+                        return false;
+                    }
+                }
+#endif
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,131 @@
+#ifndef OCCLUSION_HPP
+#define OCCLUSION_HPP
+#pragma once
+
+
+// System headers
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+
+// Local headers
+#include "bounds.hpp"
+#include "mesh.hpp"
+#include "sceneGraph.hpp"
+#include "threadPool.hpp"
+
+
+// Simplified geometry that is rasterised on the CPU to hide the nodes behind it.
+// An occluder must never cover more of the screen than the geometry it stands in for.
+struct OccluderMesh {
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned int> indices;
+};
+
+// Downsamples a terrain mesh into a gridSize x gridSize height field in the terrain's own coordinates.
+// Every grid cell lies at the lowest height the terrain reaches inside the cell, so the occluder
+// stays on or below the real surface and only hides what the terrain hides.
+OccluderMesh createTerrainOccluder(const Mesh& terrain, unsigned int gridSize = 48);
+
+// World transformations of all occluders of an OcclusionBuffer at one point in time, in the order they were added.
+// present is 0 for occluders whose node has been destroyed.
+struct OccluderTransforms {
+    std::vector<glm::mat4> matrices;
+    std::vector<unsigned char> present;
+};
+
+
+// Low resolution software depth buffer for occlusion culling.
+// Each frame, render() rasterises the occluders into the buffer, split into tiles that are rasterised in parallel,
+// four pixels at a time with SSE. isOccluded() then tells whether a box lies completely behind the rasterised occluders.
+class OcclusionBuffer {
+public:
+    // The width is rounded up to a multiple of the tile width and the height to a multiple of the tile height
+    explicit OcclusionBuffer(unsigned int width = 256, unsigned int height = 128);
+    ~OcclusionBuffer();
+
+    // Adds an occluder in the coordinates of node, which places it in the world
+    void addOccluder(const OccluderMesh& mesh, SceneNode* node);
+
+    // Clears the buffer and rasterises all occluders as seen through viewProjection.
+    // If a pool is given, triangle setup and the tiles are processed in parallel.
+    void render(const glm::mat4& viewProjection, ThreadPool* pool = nullptr);
+
+    // Same as render(), with the occluders placed by world transformations taken earlier with captureTransforms(),
+    // so that the scene graph can change while the buffer is rendered
+    void render(const glm::mat4& viewProjection, const OccluderTransforms& transforms, ThreadPool* pool = nullptr);
+
+    // Stores the current world transformation of every occluder's node
+    void captureTransforms(OccluderTransforms& transforms) const;
+
+    // Returns true if every pixel the box covers holds an occluder closer than the closest point of the box.
+    // Boxes crossing the near plane are never occluded.
+    bool isOccluded(const AABB& box) const;
+
+    // Statistics of the last render()
+    unsigned int rasterisedTriangles() const { return triangleCount; }
+    double renderMicroseconds() const { return renderTime; }
+
+    unsigned int width() const { return bufferWidth; }
+    unsigned int height() const { return bufferHeight; }
+    float depthAt(unsigned int x, unsigned int y) const { return depth[y * bufferWidth + x]; }
+
+private:
+    OcclusionBuffer(OcclusionBuffer const &) = delete;
+    OcclusionBuffer & operator =(OcclusionBuffer const &) = delete;
+
+    // A screen space triangle: three edge functions and the depth plane, each as a * x + b * y + c,
+    // and the pixel rectangle it covers
+    struct SetupTriangle {
+        float edgeA[3];
+        float edgeB[3];
+        float edgeC[3];
+        float depthA;
+        float depthB;
+        float depthC;
+        int minX;
+        int minY;
+        int maxX;
+        int maxY;
+    };
+
+    // Triangles set up by one task, and for every tile the indices of those that overlap it
+    struct TriangleChunk {
+        std::vector<SetupTriangle> triangles;
+        std::vector<std::vector<unsigned int> > bins;
+    };
+
+    struct Occluder {
+        OccluderMesh mesh;
+        SceneNodeHandle node;
+    };
+
+    void setupTriangles(size_t chunk, size_t firstTriangle, size_t lastTriangle);
+    void addTriangle(TriangleChunk& chunk, const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+    void rasteriseTile(unsigned int tile);
+
+    unsigned int bufferWidth;
+    unsigned int bufferHeight;
+    unsigned int tilesX;
+    unsigned int tilesY;
+
+    std::vector<float> depth;
+    std::vector<float> tileMaxDepth;
+
+    std::vector<Occluder> occluders;
+
+    // The view projection of the last render(), which boxes are tested with
+    glm::mat4 viewProjection;
+
+    // Clip space positions of all occluder vertices and the triangles referring to them, for the current frame
+    std::vector<glm::vec4> clipVertices;
+    std::vector<unsigned int> clipIndices;
+    std::vector<TriangleChunk> chunks;
+
+    unsigned int triangleCount;
+    double renderTime;
+};
+
+
+#endif
@@ -0,0 +1,206 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+// A finished zone. The fields are atomic so a trace can be written while the owning thread keeps recording;
+// the owning thread only ever stores to them with relaxed ordering, which costs no more than plain stores.
+struct ProfileRecord {
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> start;
+    std::atomic<uint64_t> end;
+};
+
+// The ring buffer of one thread. Zone number i is kept in records[i % PROFILER_ZONES_PER_THREAD].
+struct ProfileThread {
+    explicit ProfileThread(unsigned int id) : id(id), name(nullptr), written(0) { }
+
+    unsigned int id;
+    std::atomic<const char*> name;
+
+    // Zones recorded so far. Zones below written - PROFILER_ZONES_PER_THREAD have been overwritten.
+    std::atomic<uint64_t> written;
+    ProfileRecord records[PROFILER_ZONES_PER_THREAD];
+};
+
+// All threads that ever recorded a zone. Their buffers are kept after they exit, so their zones still show up.
+struct ProfileRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ProfileThread>> threads;
+};
+
+static ProfileRegistry& registry() {
+    static ProfileRegistry profile_registry;
+    return profile_registry;
+}
+
+static thread_local ProfileThread* tProfileThread = nullptr;
+
+// Trace timestamps count from when the program started
+static const uint64_t profiler_epoch = profilerNow();
+
+// Frame starts, written and read by the rendering thread only
+static uint64_t frame_starts[PROFILER_FRAME_HISTORY];
+static unsigned int frame_count = 0;
+static unsigned int frame_thread = 0;
+
+// Where startup ends, kept apart as the frame history wraps around
+static uint64_t first_frame_start = 0;
+
+
+/* Returns the calling thread's ring buffer, registering the thread on its first zone */
+static ProfileThread* current_thread() {
+    if (tProfileThread == nullptr) {
+        ProfileRegistry& profile_registry = registry();
+        std::lock_guard<std::mutex> lock(profile_registry.mutex);
+        profile_registry.threads.emplace_back(new ProfileThread((unsigned int)profile_registry.threads.size()));
+        tProfileThread = profile_registry.threads.back().get();
+    }
+    return tProfileThread;
+}
+
+void profilerRecord(const char* name, uint64_t start, uint64_t end) {
+    ProfileThread* thread = current_thread();
+    uint64_t index = thread->written.load(std::memory_order_relaxed);
+
+    // Orders the previous update of written before overwriting the oldest record, so a reader that sees the
+    // new record also sees that the old one is gone (see copy_records())
+    std::atomic_thread_fence(std::memory_order_release);
+
+    ProfileRecord& record = thread->records[index % PROFILER_ZONES_PER_THREAD];
+    record.name.store(name, std::memory_order_relaxed);
+    record.start.store(start, std::memory_order_relaxed);
+    record.end.store(end, std::memory_order_relaxed);
+
+    thread->written.store(index + 1, std::memory_order_release);
+}
+
+void profilerSetThreadName(const char* name) {
+    current_thread()->name.store(name, std::memory_order_relaxed);
+}
+
+void profilerMarkFrame() {
+    uint64_t now = profilerNow();
+    if (frame_count == 0) {
+        first_frame_start = now;
+    }
+    frame_thread = current_thread()->id;
+    frame_starts[frame_count % PROFILER_FRAME_HISTORY] = now;
+    frame_count++;
+}
+
+unsigned int profilerFrameCount() {
+    return frame_count;
+}
+
+
+// A zone copied out of a ring buffer
+struct ZoneCopy {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+/* Copies the records of a thread that overlap [from, to). The owning thread may overwrite records while they are
+   copied, so once done, every record that might have been overwritten in the meantime is dropped again. */
+static void copy_records(const ProfileThread& thread, uint64_t from, uint64_t to, std::vector<ZoneCopy>& zones) {
+    uint64_t written = thread.written.load(std::memory_order_acquire);
+    uint64_t first = (written > PROFILER_ZONES_PER_THREAD) ? written - PROFILER_ZONES_PER_THREAD : 0;
+
+    std::vector<std::pair<uint64_t, ZoneCopy>> copied;
+    for (uint64_t i = first; i < written; i++) {
+        const ProfileRecord& record = thread.records[i % PROFILER_ZONES_PER_THREAD];
+        ZoneCopy zone = { record.name.load(std::memory_order_relaxed),
+                          record.start.load(std::memory_order_relaxed),
+                          record.end.load(std::memory_order_relaxed) };
+        copied.push_back(std::make_pair(i, zone));
+    }
+
+    // The record for zone w - 1 may be being written while written is w - 1, so zone w - 1 - PROFILER_ZONES_PER_THREAD
+    // is unsafe as well
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t written_after = thread.written.load(std::memory_order_relaxed);
+    uint64_t safe = (written_after + 1 > PROFILER_ZONES_PER_THREAD) ? written_after + 1 - PROFILER_ZONES_PER_THREAD : 0;
+
+    for (const std::pair<uint64_t, ZoneCopy>& entry : copied) {
+        if (entry.first >= safe && entry.second.end > from && entry.second.start < to) {
+            zones.push_back(entry.second);
+        }
+    }
+}
+
+/* Microseconds since the program started, as Chrome traces count time */
+static double trace_time(uint64_t nanoseconds) {
+    return (nanoseconds > profiler_epoch) ? (nanoseconds - profiler_epoch) / 1000.0 : 0.0;
+}
+
+/* Writes the zones of all threads that overlap [from, to) and the frame starts in it as a Chrome trace */
+static bool write_trace(const std::string& filename, uint64_t from, uint64_t to) {
+    FILE* file = fopen(filename.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(file, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"gloom\"}}");
+
+    size_t zone_count = 0;
+    ProfileRegistry& profile_registry = registry();
+    {
+        std::lock_guard<std::mutex> lock(profile_registry.mutex);
+        std::vector<ZoneCopy> zones;
+        for (const std::unique_ptr<ProfileThread>& thread : profile_registry.threads) {
+            const char* name = thread->name.load(std::memory_order_relaxed);
+            if (name != nullptr) {
+                fprintf(file, ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+                        thread->id, name);
+            }
+
+            zones.clear();
+            copy_records(*thread, from, to, zones);
+            for (const ZoneCopy& zone : zones) {
+                fprintf(file, ",\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+                        zone.name, thread->id, trace_time(zone.start), (zone.end - zone.start) / 1000.0);
+            }
+            zone_count += zones.size();
+        }
+    }
+
+    unsigned int kept_frames = std::min<unsigned int>(frame_count, PROFILER_FRAME_HISTORY);
+    for (unsigned int frame = frame_count - kept_frames; frame < frame_count; frame++) {
+        uint64_t start = frame_starts[frame % PROFILER_FRAME_HISTORY];
+        if (start >= from && start < to) {
+            fprintf(file, ",\n  {\"name\": \"Frame %u\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f}",
+                    frame, frame_thread, trace_time(start));
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    bool written = (ferror(file) == 0);
+    written = (fclose(file) == 0) && written;
+
+    if (written) {
+        printf("Profiler: wrote %zu zones to %s\n", zone_count, filename.c_str());
+    }
+    return written;
+}
+
+bool profilerWriteTrace(const std::string& filename, unsigned int frames) {
+    uint64_t from = 0;
+    if (frames > 0 && frame_count > 0) {
+        unsigned int kept_frames = std::min<unsigned int>(frame_count, PROFILER_FRAME_HISTORY);
+        frames = std::min(frames, kept_frames);
+        from = frame_starts[(frame_count - frames) % PROFILER_FRAME_HISTORY];
+    }
+    return write_trace(filename, from, profilerNow());
+}
+
+bool profilerWriteStartupTrace(const std::string& filename) {
+    uint64_t to = (frame_count > 0) ? first_frame_start : profilerNow();
+    return write_trace(filename, 0, to);
+}
@@ -0,0 +1,80 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+#pragma once
+
+
+// System headers
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Set to 0 to compile all profiling zones out of the program. The macros below then expand to nothing.
+#ifndef ENABLE_PROFILER
+#define ENABLE_PROFILER 1
+#endif
+
+// Zones each thread keeps. Once full, the oldest zones of the thread are overwritten.
+#define PROFILER_ZONES_PER_THREAD 65536
+
+// Frame starts kept to find where the last frames begin
+#define PROFILER_FRAME_HISTORY 4096
+
+
+// Nanoseconds on the steady clock, which all zones are timed with
+inline uint64_t profilerNow() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Stores a finished zone in the calling thread's ring buffer. name must outlive the profiler, e.g. a string literal.
+// Only the owning thread writes to a ring buffer, so no locks or atomic read-modify-writes are needed.
+void profilerRecord(const char* name, uint64_t start, uint64_t end);
+
+// Names the calling thread in traces. name must outlive the profiler.
+void profilerSetThreadName(const char* name);
+
+// Marks the start of a frame. Called by the thread that renders, which must also be the one writing traces.
+void profilerMarkFrame();
+
+// Frames marked so far
+unsigned int profilerFrameCount();
+
+// Writes the zones of the last frames (all zones still kept if frames is 0) of every thread as a Chrome trace,
+// which chrome://tracing and Perfetto open. Returns false if the file cannot be written.
+bool profilerWriteTrace(const std::string& filename, unsigned int frames);
+
+// Writes the zones recorded before the first frame, i.e. loading the scene and creating its buffers and shaders
+bool profilerWriteStartupTrace(const std::string& filename);
+
+
+// Times the scope it lives in
+class ProfileZone {
+public:
+    explicit ProfileZone(const char* name) : name(name), start(profilerNow()) { }
+    ~ProfileZone() { profilerRecord(name, start, profilerNow()); }
+
+private:
+    ProfileZone(ProfileZone const &) = delete;
+    ProfileZone & operator =(ProfileZone const &) = delete;
+
+    const char* name;
+    uint64_t start;
+};
+
+
+#if ENABLE_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_THREAD(name) profilerSetThreadName(name)
+#define PROFILE_FRAME() profilerMarkFrame()
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+#endif
+
+
+#endif
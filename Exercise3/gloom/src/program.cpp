@@ -1,23 +1,7 @@
 // Local headers
 #include "program.hpp"
 
-// A vector that stores the value of translation motions along the x, y and z axes
-glm::vec3 camera_position = glm::vec3(0.0f, -25.0f, -80.0f); // Starting in the visible interval (z in [-100.0, -1.0])
-
-// Variables that store the value of rotational motions
-float x_angle = 0.5f;
-float y_angle = 0.0f;
-float z_angle = 0.0f;
-
-// Vectors that represent the xyz axes
-glm::vec3 x_rotation_axis = glm::vec3(1.0f, 0.0f, 0.0f);
-glm::vec3 y_rotation_axis = glm::vec3(0.0f, 1.0f, 0.0f);
-glm::vec3 z_rotation_axis = glm::vec3(0.0f, 0.0f, 1.0f);
-
-// Enum that represent the axes
-typedef enum {X_AXIS, Y_AXIS, Z_AXIS} rotation_axis;
-
-// Number of helicopters to be animated
+// Number of helicopters to be animated, unless ProgramOptions asks for another number
 #define NUM_HELICOPTERS 5
 
 // Speed of helicopter rotors
@@ -26,179 +10,332 @@ typedef enum {X_AXIS, Y_AXIS, Z_AXIS} rotation_axis;
 // Offset for drawing multiple helicopters without crashes
 #define HELICOPTER_TIME_OFFSET 0.8f
 
-/* Constructs and returns a scene graph */
-SceneNode* init_scene_graph() {
-    // Scene nodes
-    SceneNode* root_node;
-
-    SceneNode* terrain_node;
-
-    // Loading the lunar surface mesh
-    Mesh lunar_terrain("Terrain mesh");
-    lunar_terrain = loadTerrainMesh("../gloom/resources/lunarsurface.obj");
-
-    root_node = createSceneNode();
-    terrain_node = createSceneNode();
-
-    addChild(root_node, terrain_node);
-    terrain_node->vertexArrayObjectID = createVAOfromMesh(lunar_terrain);
-    terrain_node->VAOIndexCount = lunar_terrain.indices.size();
-
-    for (int i = 0; i < NUM_HELICOPTERS; i++) {
-        // Loading the helicopter
-        struct Helicopter helicopter;
-        helicopter = loadHelicopterModel("../gloom/resources/helicopter.obj");
-
-        // Generate one Scene Node for each object
-        SceneNode* body_node = createSceneNode();
-        SceneNode* mainRotor_node = createSceneNode();
-        SceneNode* tailRotor_node = createSceneNode();
-        SceneNode* door_node = createSceneNode();
-
-        // Organise the objects into a Scene Graph
-        addChild(terrain_node, body_node);
-
-        addChild(body_node, mainRotor_node);
-        addChild(body_node, tailRotor_node);
-        addChild(body_node, door_node);
-
-        // Initialize values in the SceneNode data structure
-        // VAOs
-
-        body_node->vertexArrayObjectID = createVAOfromMesh(helicopter.body);
-        mainRotor_node->vertexArrayObjectID = createVAOfromMesh(helicopter.mainRotor);
-        tailRotor_node->vertexArrayObjectID = createVAOfromMesh(helicopter.tailRotor);
-        door_node->vertexArrayObjectID = createVAOfromMesh(helicopter.door);
+// Time for one lap of a helicopter route, and the angle between the routes of consecutive helicopters
+#define HELICOPTER_LAP_TIME 7.854f
+#define HELICOPTER_ROUTE_ANGLE 2.39996f
+
+// Number of helicopters or child subtrees handed to one thread pool task.
+// Nodes with fewer children than this are updated on the calling thread.
+#define PARALLEL_GRAIN_SIZE 64
+
+// Seconds between printing how many nodes were drawn and culled
+#define CULLING_REPORT_INTERVAL 2.0
+
+// Simulation ticks per second, independent of the frame rate
+#define SIMULATION_TICK_RATE 60.0
+
+// Landing pad lights on the terrain, in a grid of this many lights per side, and their height above the terrain
+#define LANDING_PAD_GRID 16
+#define LANDING_PAD_LIGHT_HEIGHT 1.5f
+
+// Searchlight below every helicopter, in the helicopter's coordinates, and how far it reaches
+#define SEARCHLIGHT_OFFSET glm::vec3(0.0f, -1.0f, 0.0f)
+#define SEARCHLIGHT_RADIUS 30.0f
+
+// Camera movement in units per second and turning in radians per second
+#define CAMERA_SPEED 3.0f
+#define CAMERA_TURN_SPEED 3.0f
+
+// Nodes drawn and rejected by frustum culling in one frame
+struct DrawStatistics {
+    unsigned int drawnNodes;
+    unsigned int culledNodes;
+    unsigned int culledSubtrees;
+    unsigned int occludedNodes;
+};
+
+// A point light that moves with a scene node, with its position in the node's coordinates
+struct AttachedLight {
+    SceneNodeHandle node;
+    PointLight light;
+};
+
+/* Adds a mesh to the renderer's geometry buffer so that it can be shared between scene nodes */
+ModelPart create_model_part(SceneRenderer& renderer, const Mesh& mesh) {
+    ModelPart part;
+    part.meshID = renderer.addMesh(mesh);
+    part.vertexArrayObjectID = renderer.vertexArray();
+    part.VAOIndexCount = mesh.indices.size();
+    part.bounds = computeMeshBounds(mesh);
+    return part;
+}
 
-        // VAO indices
+/* Sets the appearance of a scene node to an uploaded mesh */
+void set_model_part(SceneNode* node, const ModelPart& part) {
+    node->vertexArrayObjectID = part.vertexArrayObjectID;
+    node->VAOIndexCount = part.VAOIndexCount;
+    node->meshID = part.meshID;
+    node->localBounds = part.bounds;
 
-        body_node->VAOIndexCount = (helicopter.body).indices.size();
-        mainRotor_node->VAOIndexCount = (helicopter.mainRotor).indices.size();
-        tailRotor_node->VAOIndexCount = (helicopter.tailRotor).indices.size();
-        door_node->VAOIndexCount = (helicopter.door).indices.size();
+    // The world bounds are recomputed with the node's transformation
+    markNodeDirty(node);
+}
 
-        // Reference points
-        tailRotor_node->referencePoint = glm::vec3(0.35f, 2.30f, 10.40f);
+/* Creates the scene nodes of one helicopter below parent, flying along path from start_distance, and returns its body node.
+   The nodes come from the scene node pool and the meshes are shared, so spawning allocates nothing once the pool has grown.
+   The rotor channels and the path agent are dropped automatically once the helicopter is despawned */
+SceneNode* spawn_helicopter(SceneNode* parent, const HelicopterParts& parts, SceneAnimation& animation,
+                            unsigned int path, float start_distance) {
+    // Generate one Scene Node for each object
+    SceneNode* body_node = createSceneNode();
+    SceneNode* mainRotor_node = createSceneNode();
+    SceneNode* tailRotor_node = createSceneNode();
+    SceneNode* door_node = createSceneNode();
+
+    // Organise the objects into a Scene Graph
+    addChild(parent, body_node);
+
+    addChild(body_node, mainRotor_node);
+    addChild(body_node, tailRotor_node);
+    addChild(body_node, door_node);
+
+    // Initialize values in the SceneNode data structure
+    set_model_part(body_node, parts.body);
+    set_model_part(mainRotor_node, parts.mainRotor);
+    set_model_part(tailRotor_node, parts.tailRotor);
+    set_model_part(door_node, parts.door);
+
+    // Reference points
+    setNodeReferencePoint(tailRotor_node, glm::vec3(0.35f, 2.30f, 10.40f));
+
+    // Animated parts
+    animation.channels.addChannel(getSceneNodeHandle(mainRotor_node), ANIMATE_ROTATION, ANIMATION_AXIS_Y, CURVE_SPIN, ROTOR_SPEED);
+    animation.channels.addChannel(getSceneNodeHandle(tailRotor_node), ANIMATE_ROTATION, ANIMATION_AXIS_X, CURVE_SPIN, ROTOR_SPEED);
+
+    // The helicopter completes one lap of its route in HELICOPTER_LAP_TIME seconds
+    float speed = animation.paths.pathLength(path) / HELICOPTER_LAP_TIME;
+    animation.paths.addAgent(getSceneNodeHandle(body_node), path, speed, start_distance);
+
+    return body_node;
+}
 
-        // Animated parts
-        (body_node->animated_Y).push_back(mainRotor_node);
-        (body_node->animated_X).push_back(tailRotor_node);
+/* Places a light a little above the highest point of every cell of a LANDING_PAD_GRID x LANDING_PAD_GRID grid over
+   the terrain, in the terrain's coordinates. Each light reaches a little beyond its cell. */
+std::vector<PointLight> create_landing_pad_lights(const Mesh& terrain) {
+    std::vector<PointLight> lights;
+    AABB bounds = computeMeshBounds(terrain);
+    if (isEmpty(bounds)) {
+        return lights;
+    }
+    glm::vec3 cell_size = (bounds.max - bounds.min) / (float)LANDING_PAD_GRID;
+
+    std::vector<float> heights(LANDING_PAD_GRID * LANDING_PAD_GRID, bounds.min.y);
+    for (size_t i = 0; i + 2 < terrain.vertices.size(); i += 3) {
+        int column = std::min((int)((terrain.vertices[i] - bounds.min.x) / cell_size.x), LANDING_PAD_GRID - 1);
+        int row = std::min((int)((terrain.vertices[i + 2] - bounds.min.z) / cell_size.z), LANDING_PAD_GRID - 1);
+        float& height = heights[row * LANDING_PAD_GRID + column];
+        height = std::max(height, terrain.vertices[i + 1]);
     }
 
-    return root_node;
+    const glm::vec3 colours[] = { glm::vec3(1.0f, 0.3f, 0.2f), glm::vec3(0.2f, 1.0f, 0.3f), glm::vec3(0.3f, 0.5f, 1.0f) };
+    for (int row = 0; row < LANDING_PAD_GRID; row++) {
+        for (int column = 0; column < LANDING_PAD_GRID; column++) {
+            PointLight light;
+            light.position = glm::vec3(bounds.min.x + (column + 0.5f) * cell_size.x,
+                                       heights[row * LANDING_PAD_GRID + column] + LANDING_PAD_LIGHT_HEIGHT,
+                                       bounds.min.z + (row + 0.5f) * cell_size.z);
+            light.radius = 0.75f * std::max(cell_size.x, cell_size.z);
+            light.colour = colours[(row + column) % 3];
+            light.intensity = 1.0f;
+            lights.push_back(light);
+        }
+    }
+    return lights;
 }
 
+/* Moves the attached lights to where their nodes are, skipping lights of destroyed nodes */
+void place_attached_lights(const std::vector<AttachedLight>& attached_lights, std::vector<PointLight>& lights) {
+    lights.clear();
+    for (const AttachedLight& attached : attached_lights) {
+        SceneNode* node = resolveSceneNode(attached.node);
+        if (node == nullptr) {
+            continue;
+        }
+        PointLight light = attached.light;
+        light.position = glm::vec3(node->currentTransformationMatrix * glm::vec4(attached.light.position, 1.0f));
+        lights.push_back(light);
+    }
+}
 
-/* Updates view matrix */
-glm::mat4x4 update_view_matrix(glm::mat4x4 translation_matrix, glm::mat4x4 rotation_X_matrix, glm::mat4x4 rotation_Y_matrix) {
+/* Removes a helicopter from the scene and returns its nodes to the scene node pool.
+   Handles to any of its nodes stop resolving */
+void despawn_helicopter(SceneNode* body_node) {
+    destroySceneNode(body_node);
+}
 
-    translation_matrix = glm::translate(camera_position);
-    rotation_X_matrix = glm::rotate(x_angle, x_rotation_axis);
-    rotation_Y_matrix = glm::rotate(y_angle, y_rotation_axis);
+/* Constructs and returns a scene graph with helicopter_count helicopters, adding its meshes to renderer, the channels and
+   paths animating it to animation, a simplified terrain to the occlusion buffer and the lights of the terrain and
+   helicopters to lights */
+SceneNode* init_scene_graph(SceneRenderer& renderer, SceneAnimation& animation, OcclusionBuffer& occlusion,
+                            unsigned int helicopter_count, std::vector<AttachedLight>& lights) {
+    PROFILE_ZONE("Load scene");
 
-    return rotation_X_matrix * rotation_Y_matrix  * translation_matrix;
-}
+    // Scene nodes
+    SceneNode* root_node;
 
-/* Updates MVP matrix and draws scene node */
-void draw_scene_node(SceneNode* node, glm::mat4 view_projection_matrix) {
-    glm::mat4x4 MVP_matrix = view_projection_matrix * node->currentTransformationMatrix;
+    SceneNode* terrain_node;
 
-    glUniformMatrix4fv(3, 1, GL_FALSE, &MVP_matrix[0][0]);
-    glUniformMatrix4fv(4, 1, GL_FALSE, &node->currentTransformationMatrix[0][0]);
+    // Loading the lunar surface mesh
+    Mesh lunar_terrain("Terrain mesh");
+    lunar_terrain = loadTerrainMesh("../gloom/resources/lunarsurface.obj");
 
-    glBindVertexArray(node->vertexArrayObjectID);
+    root_node = createSceneNode();
+    terrain_node = createSceneNode();
 
-    glDrawElements(GL_TRIANGLES, node->VAOIndexCount, GL_UNSIGNED_INT, nullptr);
+    addChild(root_node, terrain_node);
+    set_model_part(terrain_node, create_model_part(renderer, lunar_terrain));
+    occlusion.addOccluder(createTerrainOccluder(lunar_terrain), terrain_node);
 
-    for(SceneNode* child : node->children) {
-        draw_scene_node(child, view_projection_matrix);
+    for (const PointLight& light : create_landing_pad_lights(lunar_terrain)) {
+        AttachedLight attached = { getSceneNodeHandle(terrain_node), light };
+        lights.push_back(attached);
     }
 
-}
+    // Loading the helicopter once, all helicopters share its VAOs
+    struct Helicopter helicopter;
+    helicopter = loadHelicopterModel("../gloom/resources/helicopter.obj");
 
-/* Updates the translation matrix by position*/
-glm::mat4 update_translation_matrix(glm::vec3 position) {
-    return glm::translate(position);
-}
+    HelicopterParts helicopter_parts;
+    helicopter_parts.body = create_model_part(renderer, helicopter.body);
+    helicopter_parts.mainRotor = create_model_part(renderer, helicopter.mainRotor);
+    helicopter_parts.tailRotor = create_model_part(renderer, helicopter.tailRotor);
+    helicopter_parts.door = create_model_part(renderer, helicopter.door);
 
-/* Updates rotation matrix by translating object to the origin, perform rotation about three axes and translating back */
-glm::mat4 update_rotation_matrix(glm::vec3 rotation, glm::vec3 reference) {
-    glm::mat4x4 translate_to_origin = glm::translate(-reference);
+    // Every helicopter flies its own route: the original path, turned and scaled a little more for each helicopter
+    for (unsigned int i = 0; i < helicopter_count; i++) {
+        std::vector<glm::vec3> route = createLissajousRoute(i * HELICOPTER_ROUTE_ANGLE, 1.0f + 0.25f * sinf((float)i));
+        unsigned int path = animation.paths.addPath(route);
 
-    glm::mat4x4 rotation_x = glm::rotate(rotation.x, x_rotation_axis);
-    glm::mat4x4 rotation_y = glm::rotate(rotation.y, y_rotation_axis);
-    glm::mat4x4 rotation_z = glm::rotate(rotation.z, z_rotation_axis);
+        float start_distance = i * HELICOPTER_TIME_OFFSET * animation.paths.pathLength(path) / HELICOPTER_LAP_TIME;
+        SceneNode* body_node = spawn_helicopter(terrain_node, helicopter_parts, animation, path, start_distance);
 
-    glm::mat4x4 translate_from_origin = glm::translate(reference);
+        AttachedLight searchlight = { getSceneNodeHandle(body_node), { SEARCHLIGHT_OFFSET, SEARCHLIGHT_RADIUS,
+                                                                       glm::vec3(1.0f, 0.95f, 0.8f), 1.5f } };
+        lights.push_back(searchlight);
+    }
 
-    return (translate_from_origin * rotation_x * rotation_y * rotation_z * translate_to_origin);
+    return root_node;
 }
 
 
-/* Updates scene node by setting a nodes model matrix to updated translation and rotation matrices and the parent's transformation matrix */
-void update_scene_node(SceneNode* node, glm::mat4 parent_transformation) {
-    glm::mat4x4 node_translation = update_translation_matrix(node->position);
-    glm::mat4x4 node_rotation = update_rotation_matrix(node->rotation, node->referencePoint);
+/* First phase of drawing the scene: queues the nodes of a scene snapshot in the renderer as draw packets, skipping everything
+   outside the view frustum or hidden behind the occluders in the occlusion buffer.
+   A subtree whose bounds lie outside the frustum or behind the occluders is rejected as a whole, and once a subtree
+   lies completely inside the frustum, nothing below it is tested against the frustum any more.
+   Subtrees are consecutive in the snapshot, so rejecting one skips ahead by its size, and a subtree inside the frustum
+   ends at a known index. Nothing is drawn here, the renderer sorts and submits the packets in endFrame() */
+void collect_scene_nodes(const SceneSnapshot& snapshot, SceneRenderer& renderer, const Gloom::Frustum& frustum,
+                         const OcclusionBuffer& occlusion, DrawStatistics& statistics) {
+    PROFILE_ZONE("Collect visible nodes");
+    size_t node_count = snapshot.nodes.size();
+    size_t inside_frustum_end = 0;
+
+    size_t i = 0;
+    while (i < node_count) {
+        const SnapshotNode& node = snapshot.nodes[i];
+        bool inside_frustum = i < inside_frustum_end;
+
+        if (!inside_frustum) {
+            FrustumTest subtree_test = classifyAgainstFrustum(frustum, node.subtreeBounds);
+            if (subtree_test == FRUSTUM_OUTSIDE) {
+                statistics.culledNodes += node.subtreeMeshCount;
+                statistics.culledSubtrees++;
+                i += node.subtreeSize;
+                continue;
+            }
+            if (subtree_test == FRUSTUM_INSIDE) {
+                inside_frustum = true;
+                inside_frustum_end = i + node.subtreeSize;
+            }
+        }
 
-    node->currentTransformationMatrix = parent_transformation * node_translation * node_rotation;
+        if (occlusion.isOccluded(node.subtreeBounds)) {
+            statistics.occludedNodes += node.subtreeMeshCount;
+            i += node.subtreeSize;
+            continue;
+        }
 
-    for(SceneNode* child : node->children){
-        update_scene_node(child, node->currentTransformationMatrix);
+        // Nodes without a mesh only group their children
+        if (node.hasMesh) {
+            if (!inside_frustum && classifyAgainstFrustum(frustum, node.worldBounds) == FRUSTUM_OUTSIDE) {
+                statistics.culledNodes++;
+            } else if (node.hasChildren && occlusion.isOccluded(node.worldBounds)) {
+                // Without children the subtree bounds tested above are the node's own
+                statistics.occludedNodes++;
+            } else {
+                renderer.addDraw(node.meshID, node.transform);
+                statistics.drawnNodes++;
+            }
+        }
+        i++;
     }
 }
 
-/* Spins one helicopter part (node) about axis based on time_elapsed as to appear smooth */
-void spin_helicopter_part(SceneNode* node, float speed, double time_elapsed, rotation_axis axis) {
-    float step = speed * static_cast<float>(time_elapsed);
-
-    switch(axis) {
-        case X_AXIS:
-            node->rotation.x += step;
-            break;
-
-        case Y_AXIS:
-            node->rotation.y += step;
-            break;
-
-        case Z_AXIS:
-            node->rotation.z += step;
-            break;
+/* Updates scene node by setting a nodes model matrix to its fused local transformation and the parent's transformation matrix.
+   Only subtrees flagged as dirty are visited, and a node's matrix is only recomputed if the node itself or one of its ancestors changed.
+   If a pool is given, the children of nodes with many children are updated in parallel. Sibling subtrees are independent,
+   so every node is computed exactly as in the serial update and the results are identical */
+void update_scene_node(SceneNode* node, const glm::mat4& parent_transformation, bool parent_changed, ThreadPool* pool) {
+    if (!parent_changed && !node->subtreeDirty) {
+        return;
+    }
 
-        default:
-            break;
+    if (node->localTransformDirty) {
+        node->localTransformationMatrix = composeEulerTransform(node->position, node->rotation, node->referencePoint);
     }
-}
 
-/* Rotates all helicopter parts that are placed in node's animated vectors, which denote which of its children should rotate about which axis */
-void rotate_animated_parts(SceneNode* node, float speed, double time_elapsed) {
-    // Update rotation vector of parts that rotate around X axis
-    for(SceneNode* animation : node->animated_X){
-        spin_helicopter_part(animation, speed, time_elapsed, X_AXIS);
+    bool node_changed = parent_changed || node->localTransformDirty;
+
+    if (node_changed) {
+        node->currentTransformationMatrix = multiplyTransform(parent_transformation, node->localTransformationMatrix);
+        node->worldBounds = transformAABB(node->localBounds, node->currentTransformationMatrix);
+        node->transformVersion++;
     }
 
-    // Update rotation vector of parts that rotate around Y axis
-    for(SceneNode* animation : node->animated_Y){
-        spin_helicopter_part(animation, speed, time_elapsed, Y_AXIS);
+    node->localTransformDirty = false;
+    node->subtreeDirty = false;
+    node->subtreeVersion++;
+
+    if (pool != nullptr && node->children.size() >= PARALLEL_GRAIN_SIZE) {
+        pool->parallelFor(node->children.size(), PARALLEL_GRAIN_SIZE, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                update_scene_node(node->children[i], node->currentTransformationMatrix, node_changed, pool);
+            }
+        });
+    } else {
+        for(SceneNode* child : node->children){
+            update_scene_node(child, node->currentTransformationMatrix, node_changed, pool);
+        }
     }
 
-    // Update rotation vector of parts that rotate around Z axis
-    for(SceneNode* animation : node->animated_Z){
-        spin_helicopter_part(animation, speed, time_elapsed, Z_AXIS);
+    // Children that were not visited kept their subtree bounds, so merging them is always up to date
+    node->subtreeBounds = node->worldBounds;
+    node->subtreeMeshCount = isEmpty(node->localBounds) ? 0 : 1;
+    for(SceneNode* child : node->children){
+        node->subtreeBounds = mergeAABB(node->subtreeBounds, child->subtreeBounds);
+        node->subtreeMeshCount += child->subtreeMeshCount;
     }
 }
 
-/* Makes node follow a path given by heading by updating the nodes position and rotation variables */
-void follow_path(SceneNode* node, double current_time) {
-    struct Heading heading = simpleHeadingAnimation(current_time);
-    node->position.x = heading.x;
-    node->position.z = heading.z;
+/* Runs one simulation tick: evaluates all animation channels and paths at simulation_time */
+void simulate_scene(SceneAnimation& animation, double simulation_time, ThreadPool& pool) {
+    PROFILE_ZONE("Simulation tick");
+    animation.channels.evaluate(simulation_time);
+    animation.paths.evaluate(simulation_time, &pool);
+}
 
-    node->rotation = glm::vec3(heading.pitch, heading.yaw, heading.roll);
+/* Writes the state of the last two simulation ticks, interpolated by alpha, into the scene nodes */
+void animate_scene(SceneAnimation& animation, double alpha, ThreadPool& pool) {
+    PROFILE_ZONE("Animate");
+    animation.channels.apply((float)alpha);
+    animation.paths.apply(&pool, (float)alpha);
 }
 
 
-void runProgram(GLFWwindow* window)
+void runProgram(GLFWwindow* window, const ProgramOptions& options)
 {
+    PROFILE_THREAD("Main");
+
     // Enable depth (Z) buffer (accept "closest" fragment)
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
@@ -213,21 +350,23 @@ void runProgram(GLFWwindow* window)
     // Set default colour after clearing the colour buffer
     glClearColor(0.0f, 0.3f, 0.7f, 1.0f);
 
-    // Creating two shaders: A vertex shader and a fragment shader
-    Gloom::Shader shader;
-    shader.makeBasicShader("../gloom/shaders/simple.vert", "../gloom/shaders/simple.frag");
+    // Without a window to show them, frames are drawn into a framebuffer object of the window's size
+    OffscreenTarget offscreen_target = {};
+    if (options.offscreen) {
+        offscreen_target = createOffscreenTarget(windowWidth, windowHeight);
+    }
 
-    /* Task 4 */
-    // Creates the Model - View - Projection matrix and initializes it to a 4x4 identity matrix
-    glm::mat4x4 VP_matrix = glm::mat4(1.0f);
+    // Linked shader programs are loaded from the cache instead of compiled where possible
+    Gloom::Shader::setBinaryCacheDirectory(options.shaderCacheDirectory);
 
-    // Transformation matrices
-    glm::mat4x4 translation_matrix = glm::translate(camera_position);
-    glm::mat4x4 rotation_X_matrix = glm::rotate(x_angle, x_rotation_axis);
-    glm::mat4x4 rotation_Y_matrix = glm::rotate(y_angle, y_rotation_axis);
+    // Draws the visible nodes, each mesh once for all nodes using it, with a single indirect draw call where supported.
+    // Owns the shader programs and the geometry of all meshes.
+    SceneRenderer renderer;
 
-    // View matrix
-    glm::mat4x4 view_matrix = rotation_X_matrix * rotation_Y_matrix * translation_matrix;
+    /* Task 4 */
+    // The camera moved by the keyboard or a camera path: the negated eye position, pitch and yaw.
+    // Starting in the visible interval (z in [-100.0, -1.0]).
+    CameraPose camera_pose = { glm::vec3(0.0f, -25.0f, -80.0f), 0.5f, 0.0f };
 
     // Parameters of the projection matrix
     float FOVRadians = glm::radians(70.0); // Field of view
@@ -235,63 +374,255 @@ void runProgram(GLFWwindow* window)
     float near_plane = 1.0f; // As given in the assignment
     float far_plane = 10000.0f; // As given in the assignment
 
-    // Projection matrix
-    glm::mat4x4 projection_matrix = glm::perspective(FOVRadians, aspect_ratio, near_plane, far_plane);
+    // Owns the view, projection and view projection matrices and the view frustum, recomputed only when the pose changes
+    Gloom::Camera camera;
+    camera.setProjection(FOVRadians, aspect_ratio, near_plane, far_plane);
+
+    // Animation channels and paths of all moving parts in the scene
+    SceneAnimation animation;
 
-    SceneNode* root = init_scene_graph();
-    SceneNode* terrain = root->children[0];
+    // Software depth buffer the terrain is rasterised into to hide the helicopters behind it
+    OcclusionBuffer occlusion;
 
-    double current_time = 0.00;
+    unsigned int helicopter_count = (options.helicopterCount > 0) ? options.helicopterCount : NUM_HELICOPTERS;
+    // Landing pad lights and helicopter searchlights, placed in world coordinates in every snapshot and binned into
+    // view space clusters every frame
+    std::vector<AttachedLight> scene_lights;
+    LightClusters light_clusters;
+
+    SceneNode* root = init_scene_graph(renderer, animation, occlusion, helicopter_count, scene_lights);
+
+    // The shader programs compiled while the scene loaded. A benchmark measures the chosen render path from the
+    // first frame on, so it waits for any that are not done; otherwise the first frames fall back to the direct path.
+    if (!options.reportFile.empty()) {
+        renderer.finishPrograms();
+    }
+
+    // Real time between frames, turned into fixed simulation ticks
+    FrameClock frame_clock(SIMULATION_TICK_RATE);
+    double next_culling_report = 0.00;
+
+    // Worker threads for animating and updating large scenes
+    ThreadPool thread_pool;
+
+    // Bounding volume hierarchy over the world bounds of all drawn nodes, built once the initial transformations are known
+    BVH scene_bvh;
+    update_scene_node(root, glm::mat4(1.0f), false, &thread_pool);
+    scene_bvh.build(root);
+
+    // Simulates frame N + 1 on a worker thread while frame N is drawn here. The worker owns the scene graph,
+    // the animation and the BVH; this thread only sees the snapshots the worker leaves behind and does all OpenGL work.
+    FramePipeline pipeline([&](SceneSnapshot& snapshot) {
+        PROFILE_ZONE("Simulate frame");
+
+        // Run the simulation ticks that are due, then rotate all parts that are animated and move the helicopters
+        // along their paths to where they are between the last two ticks
+        if (options.frameSeconds > 0.0) {
+            frame_clock.beginFrame(options.frameSeconds);
+        } else {
+            frame_clock.beginFrame();
+        }
+        while (frame_clock.tick()) {
+            simulate_scene(animation, frame_clock.simulationTime(), thread_pool);
+        }
+        animate_scene(animation, frame_clock.interpolation(), thread_pool);
+
+        // Update the scene nodes that changed since the last frame
+        {
+            PROFILE_ZONE("Update scene nodes");
+            update_scene_node(root, glm::mat4(1.0f), false, &thread_pool);
+        }
+        scene_bvh.update();
+
+        captureSceneSnapshot(root, snapshot);
+        occlusion.captureTransforms(snapshot.occluders);
+        place_attached_lights(scene_lights, snapshot.lights);
+        snapshot.frameSeconds = frame_clock.frameSeconds();
+        snapshot.elapsedSeconds = frame_clock.elapsedSeconds();
+        snapshot.simulationTime = frame_clock.simulationTime();
+    });
+
+    // Measurements of every frame for the benchmark report, and the recording of the camera when asked for
+    BenchmarkRecorder benchmark(options.warmupFrames);
+    CameraRecorder camera_recorder;
+    if (!options.cameraRecordFile.empty() && !camera_recorder.open(options.cameraRecordFile)) {
+        fprintf(stderr, "Could not write the camera recording %s\n", options.cameraRecordFile.c_str());
+    }
+
+    // The renderer statistics are also appended to a log file at every report, when asked for
+    FILE* stats_log = nullptr;
+    if (!options.statsLogFile.empty()) {
+        stats_log = fopen(options.statsLogFile.c_str(), "w");
+        if (stats_log == nullptr) {
+            fprintf(stderr, "Could not write the renderer statistics log %s\n", options.statsLogFile.c_str());
+        }
+    }
+
+    // Camera version and occluder transformations the occlusion buffer was last rendered for
+    unsigned int occlusion_camera_version = 0;
+    OccluderTransforms occlusion_transforms;
+
+    std::chrono::steady_clock::time_point run_start = std::chrono::steady_clock::now();
+    unsigned int frame = 0;
+    FrameSample sample = {};
 
     // Rendering Loop
-    while (!glfwWindowShouldClose(window))
+    while ((window == nullptr || !glfwWindowShouldClose(window))
+           && (options.frameCount == 0 || frame < options.frameCount))
     {
+        PROFILE_FRAME();
+        PROFILE_ZONE("Frame");
+        std::chrono::steady_clock::time_point frame_start = std::chrono::steady_clock::now();
+        const SceneSnapshot& snapshot = pipeline.nextFrame();
+
         // Clear colour and depth buffers
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // Activate shader program
-        shader.activate();
+        // A camera path takes the place of the keyboard, following the simulated rather than the real time
+        if (options.cameraPath != nullptr) {
+            camera_pose = options.cameraPath->sample(snapshot.elapsedSeconds);
+        }
 
-        // Time elapsed since last time function was called
-        double time_elapsed = getTimeDeltaSeconds();
-        current_time += time_elapsed;
+        // Update view projection matrix, unless the camera has not moved
+        camera.setPosition(-camera_pose.position);
+        camera.setOrientation(camera_pose.pitch, camera_pose.yaw);
+        glm::mat4 VP_matrix = camera.getViewProjectionMatrix();
+
+        // Draw all visible scene nodes of the snapshot. The occlusion buffer is kept while neither the camera
+        // nor an occluder moves.
+        std::chrono::steady_clock::time_point occlusion_start = std::chrono::steady_clock::now();
+        const Gloom::Frustum& view_frustum = camera.getFrustum();
+        if (camera.getVersion() != occlusion_camera_version
+            || snapshot.occluders.matrices != occlusion_transforms.matrices
+            || snapshot.occluders.present != occlusion_transforms.present) {
+            occlusion.render(VP_matrix, snapshot.occluders, &thread_pool);
+            occlusion_camera_version = camera.getVersion();
+            occlusion_transforms = snapshot.occluders;
+        }
 
-        double current_time_with_offset = current_time;
+        std::chrono::steady_clock::time_point culling_start = std::chrono::steady_clock::now();
+        DrawStatistics draw_statistics = { 0, 0, 0, 0 };
+        if (options.pointLights) {
+            light_clusters.build(snapshot.lights, camera.getViewMatrix(), camera.getProjectionMatrix(),
+                                 glm::vec2((float)windowWidth, (float)windowHeight), &thread_pool);
+            renderer.setLightClusters(&light_clusters);
+        }
+        renderer.beginFrame(VP_matrix);
+        collect_scene_nodes(snapshot, renderer, view_frustum, occlusion, draw_statistics);
+
+        std::chrono::steady_clock::time_point submit_start = std::chrono::steady_clock::now();
+        renderer.endFrame();
+
+        if (snapshot.elapsedSeconds >= next_culling_report) {
+            printf("Culling: %u nodes drawn, %u outside the frustum (%u subtrees rejected), %u occluded\n",
+                   draw_statistics.drawnNodes, draw_statistics.culledNodes, draw_statistics.culledSubtrees, draw_statistics.occludedNodes);
+            printf("Occlusion buffer: %u triangles rasterised in %.0f us\n", occlusion.rasterisedTriangles(), occlusion.renderMicroseconds());
+            renderer.statistics().print(stdout);
+            if (stats_log != nullptr) {
+                fprintf(stats_log, "Frame %u, %.2f s\n", frame, snapshot.elapsedSeconds);
+                renderer.statistics().print(stats_log);
+            }
+            printf("Pipeline: simulation %.2f ms, last frame %.2f ms, waited %.2f ms for the simulation\n",
+                   pipeline.simulateSeconds() * 1000.0, sample.frameSeconds * 1000.0, pipeline.waitSeconds() * 1000.0);
+            next_culling_report = snapshot.elapsedSeconds + CULLING_REPORT_INTERVAL;
+        }
 
-        // Rotate all parts that are animated
-        for (SceneNode* child : terrain->children) {
-            rotate_animated_parts(child, ROTOR_SPEED, time_elapsed);
-            follow_path(child, current_time_with_offset);
-            current_time_with_offset += HELICOPTER_TIME_OFFSET;
+        // Handle other events
+        if (window != nullptr) {
+            PROFILE_ZONE("Input");
+            glfwPollEvents();
+            if (options.cameraPath == nullptr) {
+                handleKeyboardInput(window, snapshot.frameSeconds, camera_pose);
+            }
+        }
+        camera_recorder.record(snapshot.elapsedSeconds, camera_pose);
+
+        // Flip buffers. Offscreen, waiting for the frame to finish stands in for the wait on the swap, so that
+        // frames are not queued up faster than they are drawn.
+        std::chrono::steady_clock::time_point present_start = std::chrono::steady_clock::now();
+        if (options.offscreen) {
+            PROFILE_ZONE("Finish");
+            glFinish();
+        } else {
+            PROFILE_ZONE("Swap buffers");
+            glfwSwapBuffers(window);
+        }
+        std::chrono::steady_clock::time_point frame_end = std::chrono::steady_clock::now();
+
+        sample.frameSeconds = std::chrono::duration<double>(frame_end - frame_start).count();
+        sample.waitSeconds = pipeline.waitSeconds();
+        sample.occlusionSeconds = std::chrono::duration<double>(culling_start - occlusion_start).count();
+        sample.cullingSeconds = std::chrono::duration<double>(submit_start - culling_start).count();
+        sample.submitSeconds = std::chrono::duration<double>(present_start - submit_start).count();
+        sample.presentSeconds = std::chrono::duration<double>(frame_end - present_start).count();
+        sample.simulateSeconds = pipeline.simulateSeconds();
+        sample.drawnNodes = draw_statistics.drawnNodes;
+        sample.culledNodes = draw_statistics.culledNodes;
+        sample.occludedNodes = draw_statistics.occludedNodes;
+        const RenderCounters& render_counters = renderer.statistics().lastFrame();
+        sample.drawCalls = render_counters.drawCalls;
+        sample.drawCommands = render_counters.drawCommands;
+        sample.triangles = render_counters.triangles;
+        sample.programBinds = render_counters.programBinds;
+        sample.vertexArrayBinds = render_counters.vertexArrayBinds;
+        sample.uniformUploads = render_counters.uniformUploads;
+        sample.bytesUploaded = render_counters.bytesUploaded;
+        benchmark.addFrame(sample);
+
+        // Loading the scene is over once the first frame is done
+        if (frame == 0 && !options.startupTraceFile.empty() && !profilerWriteStartupTrace(options.startupTraceFile)) {
+            fprintf(stderr, "Could not write the startup trace %s\n", options.startupTraceFile.c_str());
         }
 
-        // Update view projection matrix
-        view_matrix = update_view_matrix(translation_matrix, rotation_X_matrix, rotation_Y_matrix);
-        VP_matrix = projection_matrix * view_matrix;
+        frame++;
+    }
 
-        // Update and draw all scene nodes
-        update_scene_node(root, glm::mat4(1.0f));
-        draw_scene_node(root, VP_matrix);
+    memoryPrintReport(stdout);
+    if (stats_log != nullptr) {
+        memoryPrintReport(stats_log);
+        fclose(stats_log);
+    }
 
-        // Deactivate shader program
-        shader.deactivate();
+    if (!options.traceFile.empty() && !profilerWriteTrace(options.traceFile, options.traceFrames)) {
+        fprintf(stderr, "Could not write the trace %s\n", options.traceFile.c_str());
+    }
 
-        // Handle other events
-        glfwPollEvents();
-        handleKeyboardInput(window);
+    if (options.offscreen) {
+        double run_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+        printf("Rendered %u frames offscreen in %.2f s (%.2f ms per frame)\n",
+               frame, run_seconds, (frame > 0) ? run_seconds * 1000.0 / frame : 0.0);
+    }
 
-        // Flip buffers
-        glfwSwapBuffers(window);
+    if (!options.reportFile.empty()) {
+        BenchmarkSettings settings;
+        settings.frames = frame;
+        settings.warmupFrames = options.warmupFrames;
+        settings.helicopters = helicopter_count;
+        settings.frameSeconds = options.frameSeconds;
+        settings.cameraPath = options.cameraPathName;
+        settings.renderPath = (renderer.renderPath() == RENDER_PATH_INDIRECT) ? "indirect"
+                            : (renderer.renderPath() == RENDER_PATH_INSTANCED) ? "instanced" : "direct";
+        settings.renderer = (const char*)glGetString(GL_RENDERER);
+
+        benchmark.printSummary();
+        if (benchmark.writeReport(options.reportFile, settings)) {
+            printf("Benchmark report written to %s\n", options.reportFile.c_str());
+        } else {
+            fprintf(stderr, "Could not write the benchmark report %s\n", options.reportFile.c_str());
+        }
+    }
 
+    if (options.offscreen) {
+        destroyOffscreenTarget(offscreen_target);
     }
-    // Destroy shader
-    shader.destroy();
 }
 
 
-void handleKeyboardInput(GLFWwindow* window)
+void handleKeyboardInput(GLFWwindow* window, double seconds, CameraPose& pose)
 {
-    float speed = 0.05;
+    // Movement per frame, so the camera moves equally fast at any frame rate
+    float speed = CAMERA_SPEED * (float)seconds;
+    float turn_speed = CAMERA_TURN_SPEED * (float)seconds;
     // Use escape key for terminating the GLFW window
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
     {
@@ -301,51 +632,51 @@ void handleKeyboardInput(GLFWwindow* window)
     // x translation
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
     {
-        camera_position.x += speed;
+        pose.position.x += speed;
     }
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
     {
-        camera_position.x -= speed;
+        pose.position.x -= speed;
     }
 
     // y translation
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
     {
-        camera_position.y -= speed;
+        pose.position.y -= speed;
     }
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
     {
-        camera_position.y += speed;
+        pose.position.y += speed;
     }
 
     // z translation
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
     {
-        camera_position.z -= speed;
+        pose.position.z -= speed;
     }
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
     {
-        camera_position.z += speed;
+        pose.position.z += speed;
     }
 
     // pitch
     if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS)
     {
-        x_angle -= speed;
+        pose.pitch -= turn_speed;
     }
     if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
     {
-        x_angle += speed;
+        pose.pitch += turn_speed;
     }
 
     // yaw
     if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS)
     {
-        y_angle -= speed;
+        pose.yaw -= turn_speed;
     }
     if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
     {
-        y_angle += speed;
+        pose.yaw += turn_speed;
     }
 
 }
@@ -13,6 +13,7 @@
 #include <glm/vec3.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include <chrono>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -20,25 +21,118 @@
 
 // Local headers
 #include "gloom/gloom.hpp"
+#include "gloom/camera.hpp"
 #include "gloom/shader.hpp"
 #include "mesh.hpp"
 #include "OBJLoader.hpp"
 #include "toolbox.hpp"
 #include "sceneGraph.hpp"
 #include "VAO.hpp"
+#include "transformMath.hpp"
+#include "threadPool.hpp"
+#include "animation.hpp"
+#include "splinePath.hpp"
+#include "bounds.hpp"
+#include "bvh.hpp"
+#include "occlusion.hpp"
+#include "renderer.hpp"
+#include "lightClusters.hpp"
+#include "frameClock.hpp"
+#include "sceneSnapshot.hpp"
+#include "headless.hpp"
+#include "benchmark.hpp"
+#include "profiler.hpp"
+#include "memoryTracker.hpp"
 
 #define DIM_COORDINATES 3
 #define NUM_COLOURS 4
 
-// Updates the view matrix in a MVP matrix
-glm::mat4x4 updateViewMatrix(glm::mat4x4 translation_matrix, glm::mat4x4 rotation_pitch_matrix, glm::mat4x4 rotation_yaw_matrix);
+// Where compiled shader programs are cached, relative to the working directory like the shaders and resources
+#define DEFAULT_SHADER_CACHE "../gloom/shader_cache"
+
+
+// How runProgram() runs
+struct ProgramOptions {
+    // Frames to render before returning, or 0 to run until the window is closed
+    unsigned int frameCount;
+
+    // Draw into a framebuffer object rather than the window. The window may then be nullptr (a headless context).
+    bool offscreen;
+
+    // Number of helicopters in the scene, or 0 for the default
+    unsigned int helicopterCount;
+
+    // Simulated seconds per frame whatever the real frame time, or 0 to follow the real time
+    double frameSeconds;
+
+    // Moves the camera instead of the keyboard when not nullptr, described in the report by cameraPathName
+    const CameraPath* cameraPath;
+    std::string cameraPathName;
+
+    // Writes the camera pose of every frame to this file when not empty, to be replayed as a camera path
+    std::string cameraRecordFile;
+
+    // Writes a benchmark report of all frames but the first warmupFrames to this file when not empty
+    std::string reportFile;
+    unsigned int warmupFrames;
+
+    // Writes a Chrome trace of the profiling zones of the last traceFrames frames (0 for all zones kept) to traceFile
+    // on return, and of loading the scene to startupTraceFile after the first frame, when they are not empty
+    std::string traceFile;
+    unsigned int traceFrames;
+    std::string startupTraceFile;
+
+    // Appends the renderer statistics to this file at every periodic report when not empty, besides printing them
+    std::string statsLogFile;
+
+    // Directory of the shader program binary cache, or empty to always compile the shaders
+    std::string shaderCacheDirectory;
+
+    // Light the scene with the point lights of the landing pads and helicopters, besides the directional light
+    bool pointLights;
+
+    ProgramOptions()
+        : frameCount(0), offscreen(false), helicopterCount(0), frameSeconds(0.0),
+          cameraPath(nullptr), warmupFrames(0), traceFrames(0), shaderCacheDirectory(DEFAULT_SHADER_CACHE),
+          pointLights(true) { }
+};
+
+// VAO, index count and ID in the renderer's geometry buffer of one uploaded mesh, shared by every node that draws it
+struct ModelPart {
+    int vertexArrayObjectID;
+    unsigned int VAOIndexCount;
+    int meshID;
+    AABB bounds;
+};
+
+// The uploaded parts of the helicopter model
+struct HelicopterParts {
+    ModelPart body;
+    ModelPart mainRotor;
+    ModelPart tailRotor;
+    ModelPart door;
+};
+
+// Everything that moves parts of the scene over time
+struct SceneAnimation {
+    AnimationChannels channels;
+    PathSystem paths;
+};
 
 // Main OpenGL program
-void runProgram(GLFWwindow* window);
+void runProgram(GLFWwindow* window, const ProgramOptions& options = ProgramOptions());
+
+// Adds a helicopter flying along path below parent and returns its body node, and removes one again
+SceneNode* spawn_helicopter(SceneNode* parent, const HelicopterParts& parts, SceneAnimation& animation,
+                            unsigned int path, float start_distance);
+void despawn_helicopter(SceneNode* body_node);
+
+// Brings the world matrices and bounds of the changed parts of a subtree up to date
+void update_scene_node(SceneNode* node, const glm::mat4& parent_transformation, bool parent_changed, ThreadPool* pool);
 
 
-// Function for handling keypresses
-void handleKeyboardInput(GLFWwindow* window);
+// Function for handling keypresses, moving the camera pose for a frame lasting the given number of seconds
+void handleKeyboardInput(GLFWwindow* window, double seconds, CameraPose& pose);
 
 // Checks for whether an OpenGL error occurred. If one did,
 // it prints out the error type and ID
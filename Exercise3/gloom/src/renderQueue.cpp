@@ -0,0 +1,75 @@
+#include "renderQueue.hpp"
+
+#include <cstring>
+#include <utility>
+
+
+uint64_t makeSortKey(unsigned int pass, unsigned int program, unsigned int material,
+                     unsigned int vertexArray, unsigned int mesh, float depth) {
+    // The bit pattern of a non-negative float grows with its value, so its upper bits are a depth quantised
+    // with the same relative precision at every distance
+    float clamped = (depth > 0.0f) ? depth : 0.0f;
+    uint32_t depth_bits;
+    std::memcpy(&depth_bits, &clamped, sizeof(depth_bits));
+
+    return ((uint64_t)sortKeyField(pass, 0, SORT_KEY_PASS_BITS) << SORT_KEY_PASS_SHIFT)
+         | ((uint64_t)sortKeyField(program, 0, SORT_KEY_PROGRAM_BITS) << SORT_KEY_PROGRAM_SHIFT)
+         | ((uint64_t)sortKeyField(material, 0, SORT_KEY_MATERIAL_BITS) << SORT_KEY_MATERIAL_SHIFT)
+         | ((uint64_t)sortKeyField(vertexArray, 0, SORT_KEY_VERTEX_ARRAY_BITS) << SORT_KEY_VERTEX_ARRAY_SHIFT)
+         | ((uint64_t)sortKeyField(mesh, 0, SORT_KEY_MESH_BITS) << SORT_KEY_MESH_SHIFT)
+         | (uint64_t)(depth_bits >> (32 - SORT_KEY_DEPTH_BITS));
+}
+
+void RenderQueue::push(uint64_t key, unsigned int mesh, unsigned int matrix) {
+    DrawPacket packet;
+    packet.key = key;
+    packet.mesh = mesh;
+    packet.matrix = matrix;
+    packets.push_back(packet);
+}
+
+/* Least significant byte first. All eight histograms are counted in a single pass over the packets */
+void RenderQueue::sort() {
+    size_t count = packets.size();
+    if (count < 2) {
+        return;
+    }
+    scratch.resize(count);
+
+    size_t histograms[8][256];
+    std::memset(histograms, 0, sizeof(histograms));
+    for (const DrawPacket& packet : packets) {
+        for (int byte = 0; byte < 8; byte++) {
+            histograms[byte][(packet.key >> (8 * byte)) & 0xFF]++;
+        }
+    }
+
+    DrawPacket* source = packets.data();
+    DrawPacket* destination = scratch.data();
+
+    for (int byte = 0; byte < 8; byte++) {
+        size_t* histogram = histograms[byte];
+        unsigned int shift = 8 * byte;
+
+        // Every key has the same value in this byte, so this pass would not move anything
+        if (histogram[(source[0].key >> shift) & 0xFF] == count) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (int value = 0; value < 256; value++) {
+            size_t bucket = histogram[value];
+            histogram[value] = offset;
+            offset += bucket;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            destination[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+        }
+        std::swap(source, destination);
+    }
+
+    if (source != packets.data()) {
+        packets.swap(scratch);
+    }
+}
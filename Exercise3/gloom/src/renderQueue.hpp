@@ -0,0 +1,71 @@
+#ifndef RENDER_QUEUE_HPP
+#define RENDER_QUEUE_HPP
+#pragma once
+
+
+// System headers
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Layout of a sort key, from the most to the least significant bits:
+//   pass (4) | program (6) | material (10) | vertex array (10) | mesh (14) | depth (20)
+// Sorting by the key groups draws by the state they need, most expensive change first,
+// and orders the draws of one mesh front to back.
+#define SORT_KEY_DEPTH_BITS 20
+#define SORT_KEY_MESH_BITS 14
+#define SORT_KEY_VERTEX_ARRAY_BITS 10
+#define SORT_KEY_MATERIAL_BITS 10
+#define SORT_KEY_PROGRAM_BITS 6
+#define SORT_KEY_PASS_BITS 4
+
+#define SORT_KEY_MESH_SHIFT SORT_KEY_DEPTH_BITS
+#define SORT_KEY_VERTEX_ARRAY_SHIFT (SORT_KEY_MESH_SHIFT + SORT_KEY_MESH_BITS)
+#define SORT_KEY_MATERIAL_SHIFT (SORT_KEY_VERTEX_ARRAY_SHIFT + SORT_KEY_VERTEX_ARRAY_BITS)
+#define SORT_KEY_PROGRAM_SHIFT (SORT_KEY_MATERIAL_SHIFT + SORT_KEY_MATERIAL_BITS)
+#define SORT_KEY_PASS_SHIFT (SORT_KEY_PROGRAM_SHIFT + SORT_KEY_PROGRAM_BITS)
+
+
+// Builds a sort key. Fields wider than their bits are truncated, depth is the distance along the view direction.
+uint64_t makeSortKey(unsigned int pass, unsigned int program, unsigned int material,
+                     unsigned int vertexArray, unsigned int mesh, float depth);
+
+// Parts of a key: the state a draw needs (pass, program, material and vertex array),
+// and that state together with the mesh, which is what draws must share to be batched
+inline uint64_t sortKeyState(uint64_t key) { return key >> SORT_KEY_MESH_SHIFT >> SORT_KEY_MESH_BITS; }
+inline uint64_t sortKeyBatch(uint64_t key) { return key >> SORT_KEY_MESH_SHIFT; }
+
+inline unsigned int sortKeyField(uint64_t key, unsigned int shift, unsigned int bits) {
+    return (unsigned int)((key >> shift) & ((1u << bits) - 1));
+}
+
+
+// A draw waiting in the queue: its key, the mesh it draws and the index of its world matrix
+struct DrawPacket {
+    uint64_t key;
+    unsigned int mesh;
+    unsigned int matrix;
+};
+
+
+// Draw packets collected during the scene traversal, sorted by key before they are executed
+class RenderQueue {
+public:
+    void clear() { packets.clear(); }
+    void push(uint64_t key, unsigned int mesh, unsigned int matrix);
+
+    // Stable radix sort on the keys. Bytes that are the same in every key are skipped.
+    void sort();
+
+    size_t size() const { return packets.size(); }
+    bool empty() const { return packets.empty(); }
+    const DrawPacket& operator[](size_t i) const { return packets[i]; }
+
+private:
+    std::vector<DrawPacket> packets;
+    std::vector<DrawPacket> scratch;
+};
+
+
+#endif
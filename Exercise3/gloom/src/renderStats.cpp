@@ -0,0 +1,77 @@
+#include "renderStats.hpp"
+
+#include <algorithm>
+
+
+/* Adds every counter of b to a */
+static void add_counters(RenderCounters& a, const RenderCounters& b) {
+    a.drawnNodes += b.drawnNodes;
+    a.drawCalls += b.drawCalls;
+    a.drawCommands += b.drawCommands;
+    a.triangles += b.triangles;
+    a.programBinds += b.programBinds;
+    a.vertexArrayBinds += b.vertexArrayBinds;
+    a.uniformUploads += b.uniformUploads;
+    a.bytesUploaded += b.bytesUploaded;
+}
+
+/* Subtracts every counter of b from a */
+static void subtract_counters(RenderCounters& a, const RenderCounters& b) {
+    a.drawnNodes -= b.drawnNodes;
+    a.drawCalls -= b.drawCalls;
+    a.drawCommands -= b.drawCommands;
+    a.triangles -= b.triangles;
+    a.programBinds -= b.programBinds;
+    a.vertexArrayBinds -= b.vertexArrayBinds;
+    a.uniformUploads -= b.uniformUploads;
+    a.bytesUploaded -= b.bytesUploaded;
+}
+
+
+RenderStats::RenderStats()
+    : current(), last(), frames(0), history(RENDER_STATS_WINDOW), sum() {
+}
+
+void RenderStats::endFrame() {
+    // The oldest frame in the window makes room for this one
+    RenderCounters& slot = history[frames % RENDER_STATS_WINDOW];
+    subtract_counters(sum, slot);
+    slot = current;
+    add_counters(sum, slot);
+
+    last = current;
+    current = RenderCounters();
+    frames++;
+}
+
+RenderAverages RenderStats::average() const {
+    RenderAverages average = {};
+    unsigned int count = std::min<unsigned int>(frames, RENDER_STATS_WINDOW);
+    if (count == 0) {
+        return average;
+    }
+
+    average.drawnNodes = (double)sum.drawnNodes / count;
+    average.drawCalls = (double)sum.drawCalls / count;
+    average.drawCommands = (double)sum.drawCommands / count;
+    average.triangles = (double)sum.triangles / count;
+    average.programBinds = (double)sum.programBinds / count;
+    average.vertexArrayBinds = (double)sum.vertexArrayBinds / count;
+    average.uniformUploads = (double)sum.uniformUploads / count;
+    average.bytesUploaded = (double)sum.bytesUploaded / count;
+    return average;
+}
+
+void RenderStats::print(FILE* file) const {
+    RenderAverages average = this->average();
+    unsigned int count = std::min<unsigned int>(frames, RENDER_STATS_WINDOW);
+
+    fprintf(file, "Renderer: %u draw calls (%u draws) for %u nodes, %llu triangles, %u program and %u vertex array binds, "
+                  "%u uniform uploads, %.1f KB uploaded\n",
+            last.drawCalls, last.drawCommands, last.drawnNodes, (unsigned long long)last.triangles,
+            last.programBinds, last.vertexArrayBinds, last.uniformUploads, last.bytesUploaded / 1024.0);
+    fprintf(file, "Renderer (average of %u frames): %.1f draw calls (%.1f draws) for %.1f nodes, %.0f triangles, "
+                  "%.1f program and %.1f vertex array binds, %.1f uniform uploads, %.1f KB uploaded\n",
+            count, average.drawCalls, average.drawCommands, average.drawnNodes, average.triangles,
+            average.programBinds, average.vertexArrayBinds, average.uniformUploads, average.bytesUploaded / 1024.0);
+}
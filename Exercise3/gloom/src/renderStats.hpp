@@ -0,0 +1,80 @@
+#ifndef RENDER_STATS_HPP
+#define RENDER_STATS_HPP
+#pragma once
+
+
+// System headers
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Frames the rolling averages cover
+#define RENDER_STATS_WINDOW 60
+
+
+// What drawing one frame cost
+struct RenderCounters {
+    unsigned int drawnNodes;
+
+    // Draw calls made, and the draws they contain (several for an indirect call, otherwise one)
+    unsigned int drawCalls;
+    unsigned int drawCommands;
+    uint64_t triangles;
+
+    // Program and vertex array binds, glUniform* calls and uniform buffer updates, and bytes written to buffers
+    unsigned int programBinds;
+    unsigned int vertexArrayBinds;
+    unsigned int uniformUploads;
+    uint64_t bytesUploaded;
+};
+
+// RenderCounters averaged over several frames
+struct RenderAverages {
+    double drawnNodes;
+    double drawCalls;
+    double drawCommands;
+    double triangles;
+    double programBinds;
+    double vertexArrayBinds;
+    double uniformUploads;
+    double bytesUploaded;
+};
+
+
+// Counts what the frame being drawn costs and keeps the counters of the last RENDER_STATS_WINDOW frames.
+// Whatever is counted between two endFrame() calls belongs to the frame ended by the second one, so uploads made
+// while loading the scene are counted in the first frame.
+class RenderStats {
+public:
+    RenderStats();
+
+    // Counters of the frame being drawn, for the renderer to add to
+    RenderCounters& counters() { return current; }
+
+    // Ends the frame being drawn and starts counting the next one
+    void endFrame();
+
+    // Frames ended so far
+    unsigned int frameCount() const { return frames; }
+
+    // Counters of the last ended frame, all zero before the first one
+    const RenderCounters& lastFrame() const { return last; }
+
+    // Averages over the last RENDER_STATS_WINDOW frames, or fewer if fewer were ended
+    RenderAverages average() const;
+
+    // Prints the last frame and the rolling averages, e.g. to stdout or a log file
+    void print(FILE* file) const;
+
+private:
+    RenderCounters current;
+    RenderCounters last;
+    unsigned int frames;
+
+    // The last frames in a ring, and their sum
+    std::vector<RenderCounters> history;
+    RenderCounters sum;
+};
+
+
+#endif
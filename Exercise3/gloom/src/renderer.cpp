@@ -0,0 +1,472 @@
+#include "renderer.hpp"
+#include "profiler.hpp"
+#include "memoryTracker.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Uniform locations shared by the shaders
+#define UNIFORM_MATRIX_INDEX 4
+#define UNIFORM_INSTANCE_OFFSET 5
+#define UNIFORM_DRAW_OFFSET 6
+
+// Binding points of the per frame uniforms, the world matrices and the first matrix of every indirect draw
+#define FRAME_UNIFORM_BINDING 0
+#define INSTANCE_BUFFER_BINDING 1
+#define DRAW_DATA_BUFFER_BINDING 2
+
+// Binding points of the point lights, the light range of every cluster and the light index list
+#define LIGHT_BUFFER_BINDING 3
+#define CLUSTER_BUFFER_BINDING 4
+#define LIGHT_INDEX_BUFFER_BINDING 5
+
+#define DIM_COORDINATES 3
+#define NUM_COLOURS 4
+
+
+/* Tells whether the context supports gl_DrawID, either as core OpenGL 4.6 or through the ARB extension */
+static bool draw_parameters_supported() {
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 6)) {
+        return true;
+    }
+
+    GLint extension_count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+    for (GLint i = 0; i < extension_count; i++) {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension != nullptr && std::strcmp(extension, "GL_ARB_shader_draw_parameters") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Creates an array buffer and points a vertex attribute of the bound vertex array at it */
+static GLuint create_attribute_buffer(GLuint location, GLint components) {
+    GLuint buffer = 0;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(location, components, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glEnableVertexAttribArray(location);
+    return buffer;
+}
+
+
+SceneRenderer::SceneRenderer()
+    : currentPath(RENDER_PATH_INSTANCED), drawnPath(RENDER_PATH_DIRECT), drawnLit(false), sceneShaders("../gloom/shaders/simple.vert", "../gloom/shaders/simple.frag"),
+      geometryChanged(false), geometryBytes(0),
+      frameUniformBufferSize(0), instanceBufferSize(0), drawDataBufferSize(0), commandBufferSize(0),
+      lightClusters(nullptr), lightBufferSize(0), clusterBufferSize(0), lightIndexBufferSize(0),
+      viewProjection(1.0f), frameMemoryBytes(0), stateKnown(false), boundProgram(0), boundVertexArray(0) {
+    PROFILE_ZONE("Create renderer");
+    drawParametersSupported = draw_parameters_supported();
+
+    // Every path draws with its own specialisation of the scene shaders, without and with point lights. Only the direct
+    // one without lights, which any frame can fall back to, is waited for. The others compile while the scene loads
+    // and are used once they are ready.
+    for (int lit = 0; lit < 2; lit++) {
+        Gloom::ShaderDefines lighting;
+        if (lit) {
+            lighting.add("POINT_LIGHTS");
+        }
+        programs[lit][PROGRAM_DIRECT] = &sceneShaders.request(lighting);
+        programs[lit][PROGRAM_INSTANCED] = &sceneShaders.request(Gloom::ShaderDefines(lighting).add("INSTANCED"));
+        programs[lit][PROGRAM_INDIRECT] = nullptr;
+        if (drawParametersSupported) {
+            programs[lit][PROGRAM_INDIRECT] = &sceneShaders.request(Gloom::ShaderDefines(lighting).add("INDIRECT"));
+            currentPath = RENDER_PATH_INDIRECT;
+        }
+    }
+    programs[0][PROGRAM_DIRECT]->finish();
+
+    // The same attribute locations as the VAOs from createVAO()
+    glGenVertexArrays(1, &geometryVertexArray);
+    glBindVertexArray(geometryVertexArray);
+    positionBuffer = create_attribute_buffer(0, DIM_COORDINATES);
+    colourBuffer = create_attribute_buffer(1, NUM_COLOURS);
+    normalBuffer = create_attribute_buffer(2, DIM_COORDINATES);
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBindVertexArray(0);
+
+    glGenBuffers(1, &frameUniformBuffer);
+    glGenBuffers(1, &instanceBuffer);
+    glGenBuffers(1, &drawDataBuffer);
+    glGenBuffers(1, &commandBuffer);
+    glGenBuffers(1, &lightBuffer);
+    glGenBuffers(1, &clusterBuffer);
+    glGenBuffers(1, &lightIndexBuffer);
+}
+
+SceneRenderer::~SceneRenderer() {
+    GLuint buffers[] = { positionBuffer, colourBuffer, normalBuffer, indexBuffer,
+                         frameUniformBuffer, instanceBuffer, drawDataBuffer, commandBuffer,
+                         lightBuffer, clusterBuffer, lightIndexBuffer };
+    glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+    glDeleteVertexArrays(1, &geometryVertexArray);
+
+    for (size_t i = 0; i < meshCategories.size(); i++) {
+        memoryTrack(MEMORY_CPU, meshCategories[i], -(int64_t)meshBytes[i]);
+    }
+    memorySet(MEMORY_CPU, "renderer/geometry slack", 0);
+    memorySet(MEMORY_CPU, "renderer/frame data", 0);
+    const char* gpu_categories[] = { "renderer/position buffer", "renderer/colour buffer", "renderer/normal buffer",
+                                     "renderer/index buffer", "renderer/frame uniform buffer", "renderer/instance buffer",
+                                     "renderer/draw data buffer", "renderer/command buffer", "renderer/light buffer",
+                                     "renderer/cluster buffer", "renderer/light index buffer" };
+    for (const char* category : gpu_categories) {
+        memorySet(MEMORY_GPU, category, 0);
+    }
+
+    sceneShaders.destroy();
+}
+
+int SceneRenderer::addMesh(const Mesh& mesh) {
+    PROFILE_ZONE("Add mesh");
+    MeshRange range;
+    range.vertexArray = geometryVertexArray;
+    range.firstIndex = (unsigned int)indices.size();
+    range.indexCount = (unsigned int)mesh.indices.size();
+    range.baseVertex = (int)(positions.size() / DIM_COORDINATES);
+
+    positions.insert(positions.end(), mesh.vertices.begin(), mesh.vertices.end());
+    colours.insert(colours.end(), mesh.colours.begin(), mesh.colours.end());
+    normals.insert(normals.end(), mesh.normals.begin(), mesh.normals.end());
+    indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+
+    // Meshes without colours or normals still need an entry per vertex
+    size_t vertex_count = positions.size() / DIM_COORDINATES;
+    colours.resize(vertex_count * NUM_COLOURS, 1.0f);
+    normals.resize(vertex_count * DIM_COORDINATES, 0.0f);
+
+    meshes.push_back(range);
+    geometryChanged = true;
+
+    // The renderer keeps a CPU copy of every mesh, to upload the shared buffers again when meshes are added
+    uint64_t geometry_bytes = (uint64_t)(positions.size() + colours.size() + normals.size()) * sizeof(float)
+                            + (uint64_t)indices.size() * sizeof(unsigned int);
+    uint64_t capacity_bytes = (uint64_t)(positions.capacity() + colours.capacity() + normals.capacity()) * sizeof(float)
+                            + (uint64_t)indices.capacity() * sizeof(unsigned int);
+    meshCategories.push_back("mesh/" + mesh.name);
+    meshBytes.push_back(geometry_bytes - geometryBytes);
+    geometryBytes = geometry_bytes;
+    memoryTrack(MEMORY_CPU, meshCategories.back(), (int64_t)meshBytes.back());
+    memorySet(MEMORY_CPU, "renderer/geometry slack", capacity_bytes - geometry_bytes);
+    return (int)meshes.size() - 1;
+}
+
+/* Meshes are added while the scene is loaded, so the buffers are uploaded once before the first frame rather than per mesh */
+void SceneRenderer::uploadGeometry() {
+    PROFILE_ZONE("Upload geometry");
+    glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, colourBuffer);
+    glBufferData(GL_ARRAY_BUFFER, colours.size() * sizeof(float), colours.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float), normals.data(), GL_STATIC_DRAW);
+
+    glBindVertexArray(geometryVertexArray);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    memorySet(MEMORY_GPU, "renderer/position buffer", positions.size() * sizeof(float));
+    memorySet(MEMORY_GPU, "renderer/colour buffer", colours.size() * sizeof(float));
+    memorySet(MEMORY_GPU, "renderer/normal buffer", normals.size() * sizeof(float));
+    memorySet(MEMORY_GPU, "renderer/index buffer", indices.size() * sizeof(unsigned int));
+
+    RenderCounters& counters = stats.counters();
+    counters.bytesUploaded += (positions.size() + colours.size() + normals.size()) * sizeof(float);
+    counters.bytesUploaded += indices.size() * sizeof(unsigned int);
+    geometryChanged = false;
+}
+
+void SceneRenderer::setRenderPath(RenderPath path) {
+    currentPath = (path == RENDER_PATH_INDIRECT && !drawParametersSupported) ? RENDER_PATH_INSTANCED : path;
+}
+
+void SceneRenderer::finishPrograms() {
+    PROFILE_ZONE("Finish programs");
+    for (int lit = 0; lit < 2; lit++) {
+        for (Gloom::Shader* program : programs[lit]) {
+            if (program != nullptr) {
+                program->finish();
+            }
+        }
+    }
+}
+
+/* The program in the sort keys of a path's draws */
+unsigned int SceneRenderer::pathProgram(RenderPath path) {
+    if (path == RENDER_PATH_INSTANCED) {
+        return PROGRAM_INSTANCED;
+    } else if (path == RENDER_PATH_INDIRECT) {
+        return PROGRAM_INDIRECT;
+    }
+    return PROGRAM_DIRECT;
+}
+
+void SceneRenderer::beginFrame(const glm::mat4& viewProjection) {
+    this->viewProjection = viewProjection;
+
+    // The sort keys name the program, so the path and the lighting are settled for the whole frame here. Until their
+    // program has compiled, frames fall back to the direct path, and to no point lights if that has not compiled either.
+    drawnPath = currentPath;
+    drawnLit = lightClusters != nullptr && !lightClusters->lights().empty();
+    if (!programs[drawnLit][pathProgram(drawnPath)]->isReady()) {
+        drawnPath = RENDER_PATH_DIRECT;
+        drawnLit = drawnLit && programs[1][PROGRAM_DIRECT]->isReady();
+    }
+    queue.clear();
+    modelMatrices.clear();
+}
+
+void SceneRenderer::addDraw(int meshID, const glm::mat4& modelMatrix) {
+    if (meshID < 0) {
+        return;
+    }
+    const MeshRange& range = meshes[meshID];
+
+    // Distance of the node's origin along the view direction, the w of its clip space position
+    float depth = viewProjection[0][3] * modelMatrix[3][0] + viewProjection[1][3] * modelMatrix[3][1]
+                + viewProjection[2][3] * modelMatrix[3][2] + viewProjection[3][3];
+
+    unsigned int program = pathProgram(drawnPath);
+
+    // Nodes only have vertex colours, so every node uses material 0
+    uint64_t key = makeSortKey(RENDER_PASS_OPAQUE, program, 0, range.vertexArray, (unsigned int)meshID, depth);
+
+    queue.push(key, (unsigned int)meshID, (unsigned int)modelMatrices.size());
+    modelMatrices.push_back(modelMatrix);
+}
+
+void SceneRenderer::endFrame() {
+    PROFILE_ZONE("Submit frame");
+    stateKnown = false;
+    if (queue.empty()) {
+        stats.endFrame();
+        return;
+    }
+    stats.counters().drawnNodes = (unsigned int)queue.size();
+    if (geometryChanged) {
+        uploadGeometry();
+    }
+
+    queue.sort();
+
+    // Everything a frame's draws read is uploaded once here: the view projection, and the world matrices in the sorted order
+    FrameUniforms frame_uniforms;
+    frame_uniforms.viewProjection = viewProjection;
+    uploadLights(frame_uniforms);
+    uploadBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer, frameUniformBufferSize, &frame_uniforms, sizeof(frame_uniforms),
+                 "renderer/frame uniform buffer");
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, frameUniformBuffer);
+    stats.counters().uniformUploads++;
+
+    buildBatches();
+
+    if (drawnPath == RENDER_PATH_INDIRECT) {
+        submitIndirect();
+    } else if (drawnPath == RENDER_PATH_INSTANCED) {
+        submitInstanced();
+    } else {
+        submitDirect();
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    trackFrameMemory();
+    stats.endFrame();
+}
+
+/* Uploads the lights and clusters of the frame, if it has lights, and fills in how the shaders find a fragment's cluster */
+void SceneRenderer::uploadLights(FrameUniforms& frameUniforms) {
+    frameUniforms.clusterScale = glm::vec4(0.0f);
+    frameUniforms.clusterCount = glm::uvec4(CLUSTER_COLUMNS, CLUSTER_ROWS, CLUSTER_SLICES, 0);
+    if (!drawnLit) {
+        return;
+    }
+    frameUniforms.clusterScale = lightClusters->clusterScale();
+    frameUniforms.clusterCount.w = (unsigned int)lightClusters->lights().size();
+
+    const std::vector<PointLight>& lights = lightClusters->lights();
+    const std::vector<LightCluster>& clusters = lightClusters->clusters();
+    const std::vector<uint32_t>& light_indices = lightClusters->lightIndices();
+
+    uploadBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer, lightBufferSize, lights.data(), lights.size() * sizeof(PointLight),
+                 "renderer/light buffer");
+    uploadBuffer(GL_SHADER_STORAGE_BUFFER, clusterBuffer, clusterBufferSize, clusters.data(),
+                 clusters.size() * sizeof(LightCluster), "renderer/cluster buffer");
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BUFFER_BINDING, lightBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BUFFER_BINDING, clusterBuffer);
+
+    // No cluster reads the index list when no light is in view
+    if (!light_indices.empty()) {
+        uploadBuffer(GL_SHADER_STORAGE_BUFFER, lightIndexBuffer, lightIndexBufferSize, light_indices.data(),
+                     light_indices.size() * sizeof(uint32_t), "renderer/light index buffer");
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_INDEX_BUFFER_BINDING, lightIndexBuffer);
+    }
+}
+
+/* Gives the memory tracker the CPU bytes of the per frame arrays when they have grown or shrunk */
+void SceneRenderer::trackFrameMemory() {
+    uint64_t bytes = (uint64_t)(modelMatrices.capacity() + instanceMatrices.capacity()) * sizeof(glm::mat4)
+                   + (uint64_t)batches.capacity() * sizeof(Batch)
+                   + (uint64_t)drawData.capacity() * sizeof(GLuint)
+                   + (uint64_t)commands.capacity() * sizeof(DrawElementsIndirectCommand);
+    if (bytes != frameMemoryBytes) {
+        memorySet(MEMORY_CPU, "renderer/frame data", bytes);
+        frameMemoryBytes = bytes;
+    }
+}
+
+void SceneRenderer::applyState(uint64_t key, GLuint vertexArray) {
+    unsigned int program = sortKeyField(key, SORT_KEY_PROGRAM_SHIFT, SORT_KEY_PROGRAM_BITS);
+
+    if (!stateKnown || program != boundProgram) {
+        programs[drawnLit][program]->activate();
+        boundProgram = program;
+        stats.counters().programBinds++;
+    }
+
+    if (!stateKnown || vertexArray != boundVertexArray) {
+        glBindVertexArray(vertexArray);
+        boundVertexArray = vertexArray;
+        stats.counters().vertexArrayBinds++;
+    }
+    stateKnown = true;
+}
+
+/* Draws every node on its own. The shader looks up the node's world matrix by its index in the sorted queue */
+void SceneRenderer::submitDirect() {
+    RenderCounters& counters = stats.counters();
+    for (size_t i = 0; i < queue.size(); i++) {
+        const DrawPacket& packet = queue[i];
+        const MeshRange& range = meshes[packet.mesh];
+
+        applyState(packet.key, range.vertexArray);
+
+        glUniform1ui(UNIFORM_MATRIX_INDEX, (GLuint)i);
+        counters.uniformUploads++;
+
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+                                 (void*)(range.firstIndex * sizeof(unsigned int)), range.baseVertex);
+        counters.drawCalls++;
+        counters.drawCommands++;
+        counters.triangles += range.indexCount / 3;
+    }
+}
+
+/* Orphans a buffer when it has to grow and replaces its contents, so the driver does not have to wait for last frame's draws.
+   The buffer's capacity is attributed to the memory category. */
+void SceneRenderer::uploadBuffer(GLenum target, GLuint buffer, size_t& capacity, const void* data, size_t size,
+                                 const char* category) {
+    glBindBuffer(target, buffer);
+    if (size > capacity) {
+        capacity = std::max(size, 2 * capacity);
+        memorySet(MEMORY_GPU, category, capacity);
+    }
+    glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(target, 0, size, data);
+    stats.counters().bytesUploaded += size;
+}
+
+/* Uploads the world matrices in the order of the sorted packets and splits them into batches of the same state and mesh */
+void SceneRenderer::buildBatches() {
+    instanceMatrices.clear();
+    batches.clear();
+
+    for (size_t i = 0; i < queue.size(); i++) {
+        const DrawPacket& packet = queue[i];
+        instanceMatrices.push_back(modelMatrices[packet.matrix]);
+
+        // The key only holds the low bits of the mesh, so meshes that share them are told apart by the packet
+        if (batches.empty() || sortKeyBatch(batches.back().key) != sortKeyBatch(packet.key) ||
+            batches.back().mesh != packet.mesh) {
+            Batch batch;
+            batch.key = packet.key;
+            batch.mesh = packet.mesh;
+            batch.firstInstance = (unsigned int)i;
+            batch.instanceCount = 0;
+            batches.push_back(batch);
+        }
+        batches.back().instanceCount++;
+    }
+
+    uploadBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer, instanceBufferSize,
+                 instanceMatrices.data(), instanceMatrices.size() * sizeof(glm::mat4), "renderer/instance buffer");
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, instanceBuffer);
+}
+
+/* Draws each mesh once for all its nodes */
+void SceneRenderer::submitInstanced() {
+    RenderCounters& counters = stats.counters();
+    for (const Batch& batch : batches) {
+        const MeshRange& range = meshes[batch.mesh];
+        applyState(batch.key, range.vertexArray);
+
+        glUniform1ui(UNIFORM_INSTANCE_OFFSET, batch.firstInstance);
+        counters.uniformUploads++;
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+                                          (void*)(range.firstIndex * sizeof(unsigned int)), batch.instanceCount, range.baseVertex);
+        counters.drawCalls++;
+        counters.drawCommands++;
+        counters.triangles += (uint64_t)(range.indexCount / 3) * batch.instanceCount;
+    }
+}
+
+/* Writes one indirect command per batch and the first world matrix of each into GPU buffers, then draws every run of
+   batches sharing the same state with one call. The shader finds its matrices through gl_DrawID, which restarts at
+   zero for every call, so each call also gets the index of its first command. */
+void SceneRenderer::submitIndirect() {
+    RenderCounters& counters = stats.counters();
+    commands.clear();
+    drawData.clear();
+    for (const Batch& batch : batches) {
+        const MeshRange& range = meshes[batch.mesh];
+
+        DrawElementsIndirectCommand command;
+        command.count = range.indexCount;
+        command.instanceCount = batch.instanceCount;
+        command.firstIndex = range.firstIndex;
+        command.baseVertex = range.baseVertex;
+        command.baseInstance = 0;
+
+        commands.push_back(command);
+        drawData.push_back(batch.firstInstance);
+        counters.triangles += (uint64_t)(range.indexCount / 3) * batch.instanceCount;
+    }
+
+    uploadBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer, drawDataBufferSize,
+                 drawData.data(), drawData.size() * sizeof(GLuint), "renderer/draw data buffer");
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BUFFER_BINDING, drawDataBuffer);
+
+    uploadBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer, commandBufferSize,
+                 commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand), "renderer/command buffer");
+
+    size_t run_start = 0;
+    while (run_start < batches.size()) {
+        size_t run_end = run_start + 1;
+        // Likewise the key only holds the low bits of the vertex array, which every batch of a run must share
+        GLuint vertex_array = meshes[batches[run_start].mesh].vertexArray;
+        while (run_end < batches.size() && sortKeyState(batches[run_end].key) == sortKeyState(batches[run_start].key) &&
+               meshes[batches[run_end].mesh].vertexArray == vertex_array) {
+            run_end++;
+        }
+
+        applyState(batches[run_start].key, vertex_array);
+        glUniform1ui(UNIFORM_DRAW_OFFSET, (GLuint)run_start);
+        counters.uniformUploads++;
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(run_start * sizeof(DrawElementsIndirectCommand)),
+                                    (GLsizei)(run_end - run_start), 0);
+        counters.drawCalls++;
+
+        run_start = run_end;
+    }
+    counters.drawCommands += (unsigned int)commands.size();
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,222 @@
+#ifndef RENDERER_HPP
+#define RENDERER_HPP
+#pragma once
+
+
+// System headers
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Local headers
+#include "gloom/shader.hpp"
+#include "lightClusters.hpp"
+#include "mesh.hpp"
+#include "renderQueue.hpp"
+#include "renderStats.hpp"
+
+
+// How the renderer submits the nodes of a frame
+enum RenderPath {
+    // One glDrawElements with its own uniforms per node, as the scene graph was originally drawn
+    RENDER_PATH_DIRECT,
+    // One glDrawElementsInstanced per mesh, with the world matrices of all nodes using it in a shader storage buffer
+    RENDER_PATH_INSTANCED,
+    // A single glMultiDrawElementsIndirect for the whole frame, one command per mesh
+    RENDER_PATH_INDIRECT
+};
+
+// Passes, drawn in this order. Everything is opaque today.
+enum RenderPass {
+    RENDER_PASS_OPAQUE
+};
+
+// Where a mesh lies in the shared geometry buffer
+struct MeshRange {
+    GLuint vertexArray;
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    int baseVertex;
+};
+
+// Uniforms shared by every draw of a frame, in the std140 layout of the FrameUniforms block of the shaders.
+// The cluster scale and count locate a fragment's light cluster (see LightClusters); the light count is 0 without lights.
+struct FrameUniforms {
+    glm::mat4 viewProjection;
+    glm::vec4 clusterScale;
+    glm::uvec4 clusterCount;
+};
+
+// Layout of the commands read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+
+// Collects the nodes to draw from the frame's scene snapshot and submits them at the end of the frame.
+// It never reads the scene graph, which belongs to the simulation thread.
+// Every node becomes a draw packet with a sort key (see renderQueue.hpp). The packets are sorted, so that draws
+// needing the same program and vertex array follow each other and state is only changed when it differs.
+// The view projection and the world matrices of all nodes are uploaded once per frame, and shaders compute the MVP product.
+// All meshes live in one vertex array, so that every draw of a frame can come from one indirect draw call.
+// Nodes drawing the same mesh are grouped, so the number of draw calls (instanced) or commands (indirect)
+// follows the number of distinct meshes rather than the number of nodes.
+// Needs a current OpenGL 4.3 context when constructed.
+class SceneRenderer {
+public:
+    SceneRenderer();
+    ~SceneRenderer();
+
+    // Appends a mesh to the shared geometry buffer and returns its ID
+    int addMesh(const Mesh& mesh);
+    const MeshRange& meshRange(int meshID) const { return meshes[meshID]; }
+    GLuint vertexArray() const { return geometryVertexArray; }
+
+    // The indirect path needs gl_DrawID (GL_ARB_shader_draw_parameters). Without it, the instanced path is used instead.
+    void setRenderPath(RenderPath path);
+    RenderPath renderPath() const { return currentPath; }
+
+    // The path the last frame was drawn with. Until the program of the chosen path has compiled, frames are drawn
+    // with the direct path, whose program without point lights is compiled before anything else.
+    RenderPath framePath() const { return drawnPath; }
+
+    // Waits until every program has compiled, so that no later frame falls back to the direct path
+    void finishPrograms();
+    bool supportsIndirect() const { return drawParametersSupported; }
+
+    // Starts collecting the nodes of a new frame
+    void beginFrame(const glm::mat4& viewProjection);
+
+    // Point lights of the following frames, binned for the view projection of each frame before beginFrame().
+    // Frames with lights are drawn with the POINT_LIGHTS variants of the shaders. nullptr for none.
+    void setLightClusters(const LightClusters* clusters) { lightClusters = clusters; }
+
+    // Queues a mesh for drawing with the given world transformation. Does nothing for meshID -1.
+    void addDraw(int meshID, const glm::mat4& modelMatrix);
+
+    // Submits every queued node
+    void endFrame();
+
+    // Draw calls, triangles, binds and uploads of every frame, counted from beginFrame() to endFrame()
+    const RenderStats& statistics() const { return stats; }
+
+    // Statistics of the last endFrame()
+    unsigned int drawCalls() const { return stats.lastFrame().drawCalls; }
+    unsigned int drawCommands() const { return stats.lastFrame().drawCommands; }
+    unsigned int drawnNodes() const { return stats.lastFrame().drawnNodes; }
+    unsigned int stateChanges() const { return stats.lastFrame().programBinds + stats.lastFrame().vertexArrayBinds; }
+
+private:
+    SceneRenderer(SceneRenderer const &) = delete;
+    SceneRenderer & operator =(SceneRenderer const &) = delete;
+
+    // The shader programs, as numbered in the sort keys
+    enum ShaderProgram {
+        PROGRAM_DIRECT,
+        PROGRAM_INSTANCED,
+        PROGRAM_INDIRECT,
+        PROGRAM_COUNT
+    };
+
+    // Consecutive sorted packets drawing the same mesh with the same state
+    struct Batch {
+        uint64_t key;
+        unsigned int mesh;
+        unsigned int firstInstance;
+        unsigned int instanceCount;
+    };
+
+    void uploadGeometry();
+    void buildBatches();
+    void uploadBuffer(GLenum target, GLuint buffer, size_t& capacity, const void* data, size_t size, const char* category);
+    void trackFrameMemory();
+
+    // Binds the program and vertex array a packet needs, unless they are bound already
+    void applyState(uint64_t key, GLuint vertexArray);
+
+    void submitDirect();
+    void submitInstanced();
+    void submitIndirect();
+    void uploadLights(FrameUniforms& frameUniforms);
+
+    static unsigned int pathProgram(RenderPath path);
+
+    RenderPath currentPath;
+    RenderPath drawnPath;
+    bool drawnLit;
+    bool drawParametersSupported;
+
+    // Variants of the scene shaders, and the variant each program in the sort keys stands for, without and with
+    // point lights. The indirect variants are nullptr unless the indirect path is supported.
+    // All but the direct variant without point lights may still be compiling.
+    Gloom::ShaderVariants sceneShaders;
+    Gloom::Shader* programs[2][PROGRAM_COUNT];
+
+    // Shared geometry: positions, colours and normals of all meshes one after another, and their indices
+    GLuint geometryVertexArray;
+    GLuint positionBuffer;
+    GLuint colourBuffer;
+    GLuint normalBuffer;
+    GLuint indexBuffer;
+    std::vector<float> positions;
+    std::vector<float> colours;
+    std::vector<float> normals;
+    std::vector<unsigned int> indices;
+    std::vector<MeshRange> meshes;
+    bool geometryChanged;
+
+    // Memory category of each mesh's CPU copy, the bytes attributed to it, and the bytes of all meshes
+    std::vector<std::string> meshCategories;
+    std::vector<uint64_t> meshBytes;
+    uint64_t geometryBytes;
+
+    // Per frame buffers: the frame uniforms, the world matrices, the first matrix of every draw and the indirect commands
+    GLuint frameUniformBuffer;
+    GLuint instanceBuffer;
+    GLuint drawDataBuffer;
+    GLuint commandBuffer;
+    size_t frameUniformBufferSize;
+    size_t instanceBufferSize;
+    size_t drawDataBufferSize;
+    size_t commandBufferSize;
+
+    // The lights of the frame, and buffers with the lights, the range of the light index list of every cluster and the list
+    const LightClusters* lightClusters;
+    GLuint lightBuffer;
+    GLuint clusterBuffer;
+    GLuint lightIndexBuffer;
+    size_t lightBufferSize;
+    size_t clusterBufferSize;
+    size_t lightIndexBufferSize;
+
+    glm::mat4 viewProjection;
+    RenderQueue queue;
+    std::vector<glm::mat4> modelMatrices;
+
+    // The world matrices in the order of the sorted packets, and the resulting batches
+    std::vector<glm::mat4> instanceMatrices;
+    std::vector<Batch> batches;
+    std::vector<GLuint> drawData;
+    std::vector<DrawElementsIndirectCommand> commands;
+
+    // CPU bytes of the per frame arrays above, as last given to the memory tracker
+    uint64_t frameMemoryBytes;
+
+    // State bound while executing the queue. Forgotten at the start of every frame, as other code may change it.
+    bool stateKnown;
+    unsigned int boundProgram;
+    GLuint boundVertexArray;
+
+    RenderStats stats;
+};
+
+
+#endif
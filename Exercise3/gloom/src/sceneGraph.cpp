@@ -1,4 +1,5 @@
 #include "sceneGraph.hpp"
+#include "sceneNodePool.hpp"
 #include <iostream>
 
 // --- Matrix Stack related functions ---
@@ -38,15 +39,88 @@ void printMatrix(glm::mat4 matrix) {
 
 // --- Scene Graph related functions ---
 
+// All scene nodes are allocated from this pool
+static SceneNodePool nodePool;
+
+// Counts changes to the parent/child relations of the scene
+static unsigned long sceneStructureVersion = 0;
+
 // Creates an empty SceneNode instance.
 // Values are initialised because otherwise they may contain garbage memory.
 SceneNode* createSceneNode() {
-	return new SceneNode();
+	return nodePool.allocate();
+}
+
+// Destroys a node and all of its descendants, detaching it from its parent first.
+// Their pool slots are reused by later calls to createSceneNode(), and existing handles to them stop resolving.
+void destroySceneNode(SceneNode* node) {
+	if (node->parent != nullptr) {
+		removeChild(node->parent, node);
+	}
+
+	// Descendants are released without detaching them one by one, as their parents are going away as well
+	std::vector<SceneNode*> pending(1, node);
+	while (!pending.empty()) {
+		SceneNode* current = pending.back();
+		pending.pop_back();
+
+		pending.insert(pending.end(), current->children.begin(), current->children.end());
+		nodePool.release(current);
+	}
 }
 
 // Add a child node to its parent's list of children
 void addChild(SceneNode* parent, SceneNode* child) {
+	child->indexInParent = (unsigned int) parent->children.size();
 	parent->children.push_back(child);
+	child->parent = parent;
+	sceneStructureVersion++;
+
+	// The child has to be positioned relative to its new parent on the next update. A new node is already flagged,
+	// which would stop markSubtreeDirty() at the child, so the child and the new parent's chain are flagged separately.
+	child->localTransformDirty = true;
+	child->subtreeDirty = true;
+	markSubtreeDirty(parent);
+}
+
+// Removes a child from its parent's list of children in constant time.
+// The last child takes the removed child's place, so the order of the remaining children changes.
+void removeChild(SceneNode* parent, SceneNode* child) {
+	SceneNode* last = parent->children.back();
+	parent->children[child->indexInParent] = last;
+	last->indexInParent = child->indexInParent;
+	parent->children.pop_back();
+
+	child->parent = nullptr;
+	child->indexInParent = 0;
+	sceneStructureVersion++;
+
+	// The parent's subtree changed, so anything depending on it has to be refreshed
+	markSubtreeDirty(parent);
+}
+
+// Returns a handle which can later be checked for whether the node still exists
+SceneNodeHandle getSceneNodeHandle(SceneNode* node) {
+	return nodePool.getHandle(node);
+}
+
+// Returns the node referred to by the handle, or nullptr if that node has been destroyed
+SceneNode* resolveSceneNode(SceneNodeHandle handle) {
+	return nodePool.resolve(handle);
+}
+
+// Number of nodes currently allocated from the pool
+size_t getLiveSceneNodeCount() {
+	return nodePool.liveCount();
+}
+
+// Number of nodes the pool has room for without allocating another block
+size_t getSceneNodeCapacity() {
+	return nodePool.capacity();
+}
+
+unsigned long getSceneStructureVersion() {
+	return sceneStructureVersion;
 }
 
 // Pretty prints the current values of a SceneNode instance to stdout
@@ -66,3 +140,45 @@ void printNode(SceneNode* node) {
 		node->vertexArrayObjectID);
 }
 
+
+
+// --- Change tracking related functions ---
+
+// Flags the node and all of its ancestors as containing a change.
+// Stops early when an ancestor is already flagged, as everything above an attached, flagged node is flagged as well.
+// Nodes that are not attached yet start out flagged, which is why addChild() flags the new parent's chain itself.
+void markSubtreeDirty(SceneNode* node) {
+	while (node != nullptr && !node->subtreeDirty) {
+		node->subtreeDirty = true;
+		node = node->parent;
+	}
+}
+
+// Flags the node's own transformation as changed
+void markNodeDirty(SceneNode* node) {
+	node->localTransformDirty = true;
+	markSubtreeDirty(node);
+}
+
+// Setters that only mark the node dirty when the value actually changes,
+// so nodes that are assigned the same value every frame stay clean
+void setNodePosition(SceneNode* node, glm::vec3 position) {
+	if (node->position != position) {
+		node->position = position;
+		markNodeDirty(node);
+	}
+}
+
+void setNodeRotation(SceneNode* node, glm::vec3 rotation) {
+	if (node->rotation != rotation) {
+		node->rotation = rotation;
+		markNodeDirty(node);
+	}
+}
+
+void setNodeReferencePoint(SceneNode* node, glm::vec3 referencePoint) {
+	if (node->referencePoint != referencePoint) {
+		node->referencePoint = referencePoint;
+		markNodeDirty(node);
+	}
+}
@@ -5,6 +5,7 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include <atomic>
 #include <stack>
 #include <vector>
 #include <cstdio>
@@ -14,6 +15,7 @@
 #include <chrono>
 #include <fstream>
 // #include "floats.hpp"
+#include "bounds.hpp"
 
 
 // Matrix stack related functions
@@ -24,43 +26,111 @@ glm::mat4 peekMatrix(std::stack<glm::mat4>* stack);
 
 void printMatrix(glm::mat4 matrix);
 
+// A reference to a scene node that can be checked for validity.
+// The generation of a pool slot is increased when its node is destroyed, so handles to destroyed nodes stop resolving.
+// The default handle (generation 0) never refers to a node.
+struct SceneNodeHandle {
+	unsigned int index;
+	unsigned int generation;
+
+	SceneNodeHandle() : index(0), generation(0) { }
+	SceneNodeHandle(unsigned int index, unsigned int generation) : index(index), generation(generation) { }
+};
+
 // In case you haven't got much experience with C or C++, let me explain this "typedef" you see below.
 // The point of a typedef is that you it, as its name implies, allows you to define arbitrary data types based upon existing ones. For instance, "typedef float typeWhichMightBeAFloat;" allows you to define a variable such as this one: "typeWhichMightBeAFloat variableName = 5.0;". The C/C++ compiler translates this type into a float.
 // What is the point of using it here? A smrt person, while designing the C language, thought it would be a good idea for various reasons to force you to explicitly state that you are using a data structure datatype (struct). So, when defining a variable, you'd have to type "struct SceneNode node = ..." in the case of a SceneNode. Which can get in the way of readability.
 // If we just use typedef to define a new type called "SceneNode", which really is the type "struct SceneNode", we can omit the "struct" part when creating an instance of SceneNode.
 typedef struct SceneNode {
 	SceneNode() {
+		poolIndex = 0;
+		reset();
+	}
+
+	// Restores the values of a freshly created node. The vectors are cleared rather than freed,
+	// so a node reused by the node pool keeps its capacity.
+	void reset() {
 		position = glm::vec3(0.0f, 0.0f, 0.0f);
 		rotation = glm::vec3(0.0f, 0.0f, 0.0f);
 
         referencePoint = glm::vec3(0.0f, 0.0f, 0.0f);
         vertexArrayObjectID = -1;
         VAOIndexCount = 0;
+        meshID = -1;
+
+        children.clear();
+
+        parent = nullptr;
+        indexInParent = 0;
+
+        localBounds = AABB();
+        worldBounds = AABB();
+        subtreeBounds = AABB();
+        subtreeMeshCount = 0;
+        currentTransformationMatrix = glm::mat4(1.0f);
+        localTransformationMatrix = glm::mat4(1.0f);
+
+        // A new node has never been updated, so its transformation has to be computed once
+        localTransformDirty = true;
+        subtreeDirty = true;
+        transformVersion = 0;
+        subtreeVersion = 0;
 	}
 
 	// A list of all children that belong to this node.
 	// For instance, in case of the scene graph of a human body shown in the assignment text, the "Upper Torso" node would contain the "Left Arm", "Right Arm", "Head" and "Lower Torso" nodes in its list of children.
 	std::vector<SceneNode*> children;
 
-	std::vector<SceneNode*> animated_X;
-	std::vector<SceneNode*> animated_Y;
-	std::vector<SceneNode*> animated_Z;
+	// The node this node was added to with addChild(), or nullptr for the root, and the node's position in the parent's children
+	SceneNode* parent;
+	unsigned int indexInParent;
 
-	SceneNode* heli_node;
+	// The slot of the node in the scene node pool
+	unsigned int poolIndex;
 
-	// The node's position and rotation relative to its parent
+	// The node's position and rotation relative to its parent.
+	// Change these through setNodePosition() and setNodeRotation() so that the node is marked as dirty.
 	glm::vec3 position;
 	glm::vec3 rotation;
 
-	// A transformation matrix representing the transformation of the node's location relative to its parent. This matrix is updated every frame.
+	// A transformation matrix representing the transformation of the node's location relative to the world.
+	// It is only recomputed when the node or one of its ancestors has changed.
 	glm::mat4 currentTransformationMatrix;
 
-	// The location of the node's reference point
+	// Cached transformation of the node relative to its parent, built from position, rotation and referencePoint
+	glm::mat4 localTransformationMatrix;
+
+	// The location of the node's reference point. Change it through setNodeReferencePoint().
 	glm::vec3 referencePoint;
 
+	// Change tracking: localTransformDirty is set when position, rotation or referencePoint changed,
+	// subtreeDirty is set on the node and all its ancestors so that the update can skip clean subtrees.
+	// subtreeDirty is atomic because nodes in different subtrees may be animated in parallel and share ancestors.
+	bool localTransformDirty;
+	std::atomic<bool> subtreeDirty;
+
+	// Incremented every time currentTransformationMatrix is recomputed (transformVersion)
+	// or anything in the subtree rooted at this node is recomputed (subtreeVersion).
+	// Consumers such as culling can compare these against a stored value to detect movement.
+	unsigned long transformVersion;
+	unsigned long subtreeVersion;
+
+	// Bounding box of the node's mesh in its own coordinates (empty for nodes without a mesh),
+	// and the same box in world coordinates, recomputed together with currentTransformationMatrix
+	AABB localBounds;
+	AABB worldBounds;
+
+	// World bounds of the node and all its descendants, and how many of them have a mesh.
+	// Recomputed whenever the update visits the node, so culling can reject whole subtrees.
+	AABB subtreeBounds;
+	unsigned int subtreeMeshCount;
+
 	// The ID of the VAO containing the "appearance" of this SceneNode.
 	int vertexArrayObjectID;
 	unsigned int VAOIndexCount;
+
+	// The mesh in the renderer's shared geometry buffer, or -1
+	int meshID;
 } SceneNode;
 
 // Struct for keeping track of 2D coordinates
@@ -68,8 +138,26 @@ typedef struct SceneNode {
 
 
 SceneNode* createSceneNode();
+void destroySceneNode(SceneNode* node);
 void addChild(SceneNode* parent, SceneNode* child);
+void removeChild(SceneNode* parent, SceneNode* child);
 void printNode(SceneNode* node);
 
+// Handle related functions
+SceneNodeHandle getSceneNodeHandle(SceneNode* node);
+SceneNode* resolveSceneNode(SceneNodeHandle handle);
+size_t getLiveSceneNodeCount();
+size_t getSceneNodeCapacity();
+
+// Incremented whenever a node is added to or removed from a parent, so spatial structures know when to rebuild
+unsigned long getSceneStructureVersion();
+
+// Change tracking related functions
+void setNodePosition(SceneNode* node, glm::vec3 position);
+void setNodeRotation(SceneNode* node, glm::vec3 rotation);
+void setNodeReferencePoint(SceneNode* node, glm::vec3 referencePoint);
+void markNodeDirty(SceneNode* node);
+void markSubtreeDirty(SceneNode* node);
+
 
 // For more details, see SceneGraph.cpp.
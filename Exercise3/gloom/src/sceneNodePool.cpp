@@ -0,0 +1,55 @@
+#include "sceneNodePool.hpp"
+#include "memoryTracker.hpp"
+
+#include <cassert>
+
+
+SceneNode* SceneNodePool::allocate() {
+    if (freeSlots.empty()) {
+        unsigned int first = (unsigned int)capacity();
+        blocks.emplace_back(new SceneNode[BLOCK_SIZE]);
+        generations.resize(capacity(), 0);
+        memorySet(MEMORY_CPU, "scene node pool", capacity() * (sizeof(SceneNode) + sizeof(unsigned int)));
+
+        // Pushed in reverse so that slots are handed out in ascending order
+        for (unsigned int i = BLOCK_SIZE; i > 0; i--) {
+            freeSlots.push_back(first + i - 1);
+        }
+    }
+
+    unsigned int index = freeSlots.back();
+    freeSlots.pop_back();
+
+    generations[index]++;
+    live++;
+
+    SceneNode* node = slot(index);
+    node->reset();
+    node->poolIndex = index;
+    return node;
+}
+
+void SceneNodePool::release(SceneNode* node) {
+    unsigned int index = node->poolIndex;
+    assert(slot(index) == node && (generations[index] & 1) == 1);
+
+    generations[index]++;
+    live--;
+
+    // Drop references to other nodes right away, the rest is reset when the slot is reused
+    node->children.clear();
+    node->parent = nullptr;
+
+    freeSlots.push_back(index);
+}
+
+SceneNodeHandle SceneNodePool::getHandle(const SceneNode* node) const {
+    return SceneNodeHandle(node->poolIndex, generations[node->poolIndex]);
+}
+
+SceneNode* SceneNodePool::resolve(SceneNodeHandle handle) const {
+    if (handle.index >= generations.size() || generations[handle.index] != handle.generation || (handle.generation & 1) == 0) {
+        return nullptr;
+    }
+    return slot(handle.index);
+}
@@ -0,0 +1,53 @@
+#ifndef SCENE_NODE_POOL_HPP
+#define SCENE_NODE_POOL_HPP
+#pragma once
+
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Local headers
+#include "sceneGraph.hpp"
+
+
+// Allocates scene nodes in contiguous blocks that are never freed or moved, so node pointers stay valid while the node lives.
+// Destroyed nodes go onto a free list and their slots are handed out again, so creating and destroying nodes
+// does not touch the general purpose allocator once the pool has grown to the scene's peak size.
+// Not thread safe: nodes are created and destroyed by the thread that owns the scene.
+class SceneNodePool {
+public:
+    SceneNodePool() : live(0) { }
+
+    // Returns a reset node from the free list, or from a new block if the free list is empty
+    SceneNode* allocate();
+
+    // Returns the node's slot to the free list and invalidates all handles to it
+    void release(SceneNode* node);
+
+    SceneNodeHandle getHandle(const SceneNode* node) const;
+
+    // Returns nullptr if the handle is the default handle or its node has been released
+    SceneNode* resolve(SceneNodeHandle handle) const;
+
+    size_t liveCount() const { return live; }
+    size_t capacity() const { return blocks.size() * BLOCK_SIZE; }
+
+private:
+    SceneNodePool(SceneNodePool const &) = delete;
+    SceneNodePool & operator =(SceneNodePool const &) = delete;
+
+    static const unsigned int BLOCK_SIZE = 1024;
+
+    SceneNode* slot(unsigned int index) const { return &blocks[index / BLOCK_SIZE][index % BLOCK_SIZE]; }
+
+    std::vector<std::unique_ptr<SceneNode[]>> blocks;
+
+    // Current generation of every slot. Odd generations are live, even generations are free.
+    std::vector<unsigned int> generations;
+    std::vector<unsigned int> freeSlots;
+    size_t live;
+};
+
+
+#endif
@@ -0,0 +1,114 @@
+#include "sceneSnapshot.hpp"
+#include "profiler.hpp"
+
+#include <chrono>
+#include <utility>
+
+
+/* Appends node and its descendants depth first and returns the number of nodes appended */
+static unsigned int capture_node(SceneNode* node, std::vector<SnapshotNode>& nodes) {
+    size_t index = nodes.size();
+    nodes.emplace_back();
+    {
+        SnapshotNode& entry = nodes[index];
+        entry.transform = node->currentTransformationMatrix;
+        entry.worldBounds = node->worldBounds;
+        entry.subtreeBounds = node->subtreeBounds;
+        entry.subtreeMeshCount = node->subtreeMeshCount;
+        entry.meshID = node->meshID;
+        entry.hasMesh = !isEmpty(node->localBounds);
+        entry.hasChildren = !node->children.empty();
+    }
+
+    unsigned int size = 1;
+    for (SceneNode* child : node->children) {
+        size += capture_node(child, nodes);
+    }
+
+    // Looked up again, as appending the children may have moved the array
+    nodes[index].subtreeSize = size;
+    return size;
+}
+
+void captureSceneSnapshot(SceneNode* root, SceneSnapshot& snapshot) {
+    PROFILE_ZONE("Capture snapshot");
+    snapshot.nodes.clear();
+    capture_node(root, snapshot.nodes);
+}
+
+
+FramePipeline::FramePipeline(std::function<void(SceneSnapshot&)> simulate, bool threaded)
+    : simulate(std::move(simulate)), writeIndex(0), threaded(threaded),
+      requested(true), finished(false), stopping(false),
+      waitTime(0.0), simulateTime(0.0), workerSimulateTime(0.0) {
+    if (threaded) {
+        worker = std::thread(&FramePipeline::workerLoop, this);
+    }
+}
+
+FramePipeline::~FramePipeline() {
+    if (!threaded) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    worker.join();
+}
+
+const SceneSnapshot& FramePipeline::nextFrame() {
+    if (!threaded) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        simulate(snapshots[0]);
+        simulateTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        waitTime = simulateTime;
+        return snapshots[0];
+    }
+
+    PROFILE_ZONE("Wait for simulation");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    unsigned int readIndex;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return finished; });
+
+        readIndex = writeIndex;
+        writeIndex = 1 - writeIndex;
+        simulateTime = workerSimulateTime;
+        finished = false;
+        requested = true;
+    }
+    condition.notify_all();
+    waitTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return snapshots[readIndex];
+}
+
+void FramePipeline::workerLoop() {
+    PROFILE_THREAD("Simulation");
+    while (true) {
+        unsigned int index;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return requested || stopping; });
+            if (stopping) {
+                return;
+            }
+            requested = false;
+            index = writeIndex;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        simulate(snapshots[index]);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            workerSimulateTime = seconds;
+            finished = true;
+        }
+        condition.notify_all();
+    }
+}
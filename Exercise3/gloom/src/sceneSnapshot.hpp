@@ -0,0 +1,103 @@
+#ifndef SCENE_SNAPSHOT_HPP
+#define SCENE_SNAPSHOT_HPP
+#pragma once
+
+
+// System headers
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Local headers
+#include "bounds.hpp"
+#include "lightClusters.hpp"
+#include "occlusion.hpp"
+#include "sceneGraph.hpp"
+
+
+// What culling and drawing need of one scene node
+struct SnapshotNode {
+    glm::mat4 transform;
+    AABB worldBounds;
+    AABB subtreeBounds;
+
+    // Nodes in the subtree rooted at this node, itself included. The next node outside the subtree is this many entries on.
+    unsigned int subtreeSize;
+    unsigned int subtreeMeshCount;
+
+    int meshID;
+    bool hasMesh;
+    bool hasChildren;
+};
+
+// The render relevant state of the scene at the end of a simulated frame.
+// Nodes are stored depth first, so every subtree is a consecutive range of nodes.
+struct SceneSnapshot {
+    std::vector<SnapshotNode> nodes;
+    OccluderTransforms occluders;
+
+    // Point lights in world coordinates
+    std::vector<PointLight> lights;
+
+    // Real seconds the simulated frame lasted and since the start, and the simulation time it shows
+    double frameSeconds;
+    double elapsedSeconds;
+    double simulationTime;
+};
+
+// Copies the subtree rooted at root into snapshot, reusing the snapshot's memory.
+// The world transformations and bounds must be up to date.
+void captureSceneSnapshot(SceneNode* root, SceneSnapshot& snapshot);
+
+
+// Runs the simulation of a frame on a worker thread while the caller renders the frame before it.
+// simulate fills a snapshot with the next frame. Two snapshots are used in turn, so the worker writes one while
+// the caller reads the other. The first frame is started when the pipeline is created.
+class FramePipeline {
+public:
+    // If threaded is false, every frame is simulated on the calling thread in nextFrame(), one after the other
+    explicit FramePipeline(std::function<void(SceneSnapshot&)> simulate, bool threaded = true);
+    ~FramePipeline();
+
+    // Waits until the frame being simulated is done, starts simulating the next one and returns the finished one.
+    // The returned snapshot stays unchanged until the next call.
+    const SceneSnapshot& nextFrame();
+
+    // Seconds the caller waited for the worker in the last nextFrame(), and the worker took to simulate the frame
+    double waitSeconds() const { return waitTime; }
+    double simulateSeconds() const { return simulateTime; }
+
+private:
+    FramePipeline(FramePipeline const &) = delete;
+    FramePipeline & operator =(FramePipeline const &) = delete;
+
+    void workerLoop();
+
+    std::function<void(SceneSnapshot&)> simulate;
+    SceneSnapshot snapshots[2];
+
+    // The snapshot the worker writes to; the other one belongs to the caller
+    unsigned int writeIndex;
+
+    bool threaded;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool requested;
+    bool finished;
+    bool stopping;
+
+    double waitTime;
+    double simulateTime;
+
+    // Written by the worker, copied to simulateTime by the caller while it holds the mutex
+    double workerSimulateTime;
+};
+
+
+#endif
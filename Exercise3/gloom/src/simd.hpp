@@ -0,0 +1,18 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+#pragma once
+
+
+// Which vector instructions the compiler may use. SIMD_SSE is set whenever SSE is available, which includes every
+// x86-64 target, and SIMD_AVX as well when the build targets AVX. Code without either keeps a scalar path.
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_AVX
+#define SIMD_SSE
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SIMD_SSE
+#endif
+
+
+#endif
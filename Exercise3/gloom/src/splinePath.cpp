@@ -0,0 +1,396 @@
+#include "splinePath.hpp"
+#include "simd.hpp"
+#include "transformMath.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// Entries in the arc length table of every path
+#define ARC_LENGTH_TABLE_SIZE 256
+
+// Samples per segment used to measure arc length when building the table
+#define ARC_LENGTH_SAMPLES_PER_SEGMENT 32
+
+// Nose down tilt per unit of speed, matching the finite difference pitch of simpleHeadingAnimation()
+#define PATH_PITCH_PER_SPEED 0.00873f
+
+// Acceleration that results in a 45 degree bank, and the largest bank angle allowed
+#define PATH_BANK_ACCELERATION 100.0f
+#define PATH_MAX_BANK 0.7854f
+
+// Agents handed to one thread pool task
+#define PATH_GRAIN_SIZE 256
+
+
+/* Polynomial arctangent with a maximum error of about 1e-5 radians, several times faster than std::atan2.
+   The octant corrections are selects rather than branches, so the compiler can keep it branch free */
+static inline float fast_atan2(float y, float x) {
+    float abs_x = std::fabs(x);
+    float abs_y = std::fabs(y);
+    float ratio = std::min(abs_x, abs_y) / std::max(std::max(abs_x, abs_y), 1e-30f);
+    float square = ratio * ratio;
+
+    float angle = ratio * (0.9998660f + square * (-0.3302995f + square * (0.1801410f + square * (-0.0851330f + square * 0.0208351f))));
+    angle = (abs_y > abs_x) ? 1.57079633f - angle : angle;
+    angle = (x < 0.0f) ? 3.14159265f - angle : angle;
+    return (y < 0.0f) ? -angle : angle;
+}
+
+#if defined(SIMD_SSE)
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+/* fast_atan2 of four pairs, the same operations in the same order so that both give identical results */
+static inline __m128 fast_atan2_4(__m128 y, __m128 x) {
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 abs_x = _mm_andnot_ps(sign, x);
+    __m128 abs_y = _mm_andnot_ps(sign, y);
+    __m128 ratio = _mm_div_ps(_mm_min_ps(abs_x, abs_y), _mm_max_ps(_mm_max_ps(abs_x, abs_y), _mm_set1_ps(1e-30f)));
+    __m128 square = _mm_mul_ps(ratio, ratio);
+
+    __m128 polynomial = _mm_add_ps(_mm_set1_ps(-0.0851330f), _mm_mul_ps(square, _mm_set1_ps(0.0208351f)));
+    polynomial = _mm_add_ps(_mm_set1_ps(0.1801410f), _mm_mul_ps(square, polynomial));
+    polynomial = _mm_add_ps(_mm_set1_ps(-0.3302995f), _mm_mul_ps(square, polynomial));
+    polynomial = _mm_add_ps(_mm_set1_ps(0.9998660f), _mm_mul_ps(square, polynomial));
+    __m128 angle = _mm_mul_ps(ratio, polynomial);
+
+    angle = select4(_mm_cmpgt_ps(abs_y, abs_x), _mm_sub_ps(_mm_set1_ps(1.57079633f), angle), angle);
+    angle = select4(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(3.14159265f), angle), angle);
+    return _mm_xor_ps(angle, _mm_and_ps(_mm_cmplt_ps(y, _mm_setzero_ps()), sign));
+}
+#endif
+
+unsigned int PathSystem::addPath(const std::vector<glm::vec3>& controlPoints) {
+    assert(controlPoints.size() >= 4);
+
+    unsigned int pathIndex = (unsigned int)lengths.size();
+    unsigned int segmentCount = (unsigned int)controlPoints.size();
+    unsigned int firstSegment = (unsigned int)segments.size();
+
+    // Uniform Catmull-Rom segment from p1 to p2 as a cubic polynomial in t
+    for (unsigned int i = 0; i < segmentCount; i++) {
+        glm::vec3 p0 = controlPoints[(i + segmentCount - 1) % segmentCount];
+        glm::vec3 p1 = controlPoints[i];
+        glm::vec3 p2 = controlPoints[(i + 1) % segmentCount];
+        glm::vec3 p3 = controlPoints[(i + 2) % segmentCount];
+
+        SplineSegment segment;
+        segment.a = 0.5f * (-p0 + 3.0f * p1 - 3.0f * p2 + p3);
+        segment.b = 0.5f * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3);
+        segment.c = 0.5f * (p2 - p0);
+        segment.d = p1;
+        segments.push_back(segment);
+    }
+
+    // Measure the cumulative length at densely spaced parameters
+    unsigned int sampleCount = segmentCount * ARC_LENGTH_SAMPLES_PER_SEGMENT;
+    std::vector<float> cumulative(sampleCount + 1, 0.0f);
+    glm::vec3 previous = segments[firstSegment].d;
+
+    for (unsigned int sample = 1; sample <= sampleCount; sample++) {
+        unsigned int segment = std::min(sample / ARC_LENGTH_SAMPLES_PER_SEGMENT, segmentCount - 1);
+        float t = (float)sample / ARC_LENGTH_SAMPLES_PER_SEGMENT - (float)segment;
+        const SplineSegment& s = segments[firstSegment + segment];
+
+        glm::vec3 point = ((s.a * t + s.b) * t + s.c) * t + s.d;
+        cumulative[sample] = cumulative[sample - 1] + glm::length(point - previous);
+        previous = point;
+    }
+    float length = cumulative[sampleCount];
+
+    // Invert the cumulative lengths into parameters at equally spaced distances
+    firstTableEntries.push_back((unsigned int)arcLengthTable.size());
+    unsigned int sample = 0;
+
+    for (unsigned int entry = 0; entry < ARC_LENGTH_TABLE_SIZE; entry++) {
+        float distance = length * (float)entry / (ARC_LENGTH_TABLE_SIZE - 1);
+        while (sample < sampleCount - 1 && cumulative[sample + 1] < distance) {
+            sample++;
+        }
+
+        float span = cumulative[sample + 1] - cumulative[sample];
+        float fraction = (span > 0.0f) ? glm::clamp((distance - cumulative[sample]) / span, 0.0f, 1.0f) : 0.0f;
+        arcLengthTable.push_back(((float)sample + fraction) / ARC_LENGTH_SAMPLES_PER_SEGMENT);
+    }
+
+    firstSegments.push_back(firstSegment);
+    segmentCounts.push_back(segmentCount);
+    lengths.push_back(length);
+
+    return pathIndex;
+}
+
+size_t PathSystem::addAgent(SceneNodeHandle target, unsigned int path, float speed, float startDistance) {
+    targets.push_back(target);
+    agentPaths.push_back(path);
+    speeds.push_back(speed);
+    startDistances.push_back(startDistance);
+
+    positions.push_back(glm::vec3(0.0f));
+    yaws.push_back(0.0f);
+    pitches.push_back(0.0f);
+    rolls.push_back(0.0f);
+
+    // A new agent starts where it is at the last evaluated time, so it is not interpolated from the origin
+    size_t agent = targets.size() - 1;
+    evaluateRange(agent, agent + 1, evaluatedTime);
+    previousPositions.push_back(positions[agent]);
+    previousYaws.push_back(yaws[agent]);
+    previousPitches.push_back(pitches[agent]);
+    previousRolls.push_back(rolls[agent]);
+
+    return agent;
+}
+
+/* Finds the segment an agent is on at the given time and the spline parameter t within it */
+void PathSystem::locate(size_t agent, double time, unsigned int& segment, float& t) const {
+    unsigned int path = agentPaths[agent];
+    float length = lengths[path];
+
+    // Distance travelled, wrapped in double precision so that long running times stay exact
+    double travelled = (double)startDistances[agent] + (double)speeds[agent] * time;
+    float distance = (float)(travelled - (double)length * std::floor(travelled / (double)length));
+
+    // Constant speed: look up the spline parameter for the distance
+    float position_in_table = distance / length * (ARC_LENGTH_TABLE_SIZE - 1);
+    unsigned int entry = std::min((unsigned int)position_in_table, (unsigned int)ARC_LENGTH_TABLE_SIZE - 2);
+    float fraction = position_in_table - (float)entry;
+
+    const float* table = &arcLengthTable[firstTableEntries[path] + entry];
+    float parameter = table[0] + (table[1] - table[0]) * fraction;
+
+    segment = std::min((unsigned int)parameter, segmentCounts[path] - 1);
+    t = parameter - (float)segment;
+    segment += firstSegments[path];
+}
+
+/* Four agents at a time with SSE where available. Looking up the segments is a gather through the agents' paths,
+   so it stays scalar, and the segments are transposed into one register per coefficient for the arithmetic. */
+void PathSystem::evaluateRange(size_t begin, size_t end, double time) {
+    size_t i = begin;
+
+#if defined(SIMD_SSE)
+    for (; i + 4 <= end; i += 4) {
+        const SplineSegment* lane[4];
+        float lane_t[4];
+        for (int k = 0; k < 4; k++) {
+            unsigned int segment;
+            locate(i + k, time, segment, lane_t[k]);
+            lane[k] = &segments[segment];
+        }
+
+        __m128 ax = _mm_setr_ps(lane[0]->a.x, lane[1]->a.x, lane[2]->a.x, lane[3]->a.x);
+        __m128 ay = _mm_setr_ps(lane[0]->a.y, lane[1]->a.y, lane[2]->a.y, lane[3]->a.y);
+        __m128 az = _mm_setr_ps(lane[0]->a.z, lane[1]->a.z, lane[2]->a.z, lane[3]->a.z);
+        __m128 bx = _mm_setr_ps(lane[0]->b.x, lane[1]->b.x, lane[2]->b.x, lane[3]->b.x);
+        __m128 by = _mm_setr_ps(lane[0]->b.y, lane[1]->b.y, lane[2]->b.y, lane[3]->b.y);
+        __m128 bz = _mm_setr_ps(lane[0]->b.z, lane[1]->b.z, lane[2]->b.z, lane[3]->b.z);
+        __m128 cx = _mm_setr_ps(lane[0]->c.x, lane[1]->c.x, lane[2]->c.x, lane[3]->c.x);
+        __m128 cy = _mm_setr_ps(lane[0]->c.y, lane[1]->c.y, lane[2]->c.y, lane[3]->c.y);
+        __m128 cz = _mm_setr_ps(lane[0]->c.z, lane[1]->c.z, lane[2]->c.z, lane[3]->c.z);
+        __m128 dx = _mm_setr_ps(lane[0]->d.x, lane[1]->d.x, lane[2]->d.x, lane[3]->d.x);
+        __m128 dy = _mm_setr_ps(lane[0]->d.y, lane[1]->d.y, lane[2]->d.y, lane[3]->d.y);
+        __m128 dz = _mm_setr_ps(lane[0]->d.z, lane[1]->d.z, lane[2]->d.z, lane[3]->d.z);
+        __m128 t = _mm_loadu_ps(lane_t);
+
+        // Position and its first and second derivatives from the cubic
+        __m128 px = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(ax, t), bx), t), cx), t), dx);
+        __m128 py = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(ay, t), by), t), cy), t), dy);
+        __m128 pz = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(az, t), bz), t), cz), t), dz);
+
+        const __m128 two = _mm_set1_ps(2.0f);
+        const __m128 three = _mm_set1_ps(3.0f);
+        const __m128 six = _mm_set1_ps(6.0f);
+        __m128 tx = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(three, ax), t), _mm_mul_ps(two, bx)), t), cx);
+        __m128 ty = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(three, ay), t), _mm_mul_ps(two, by)), t), cy);
+        __m128 tz = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(three, az), t), _mm_mul_ps(two, bz)), t), cz);
+        __m128 bend_x = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(six, ax), t), _mm_mul_ps(two, bx));
+        __m128 bend_z = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(six, az), t), _mm_mul_ps(two, bz));
+
+        __m128 horizontal_squared = _mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(tz, tz));
+        __m128 horizontal = _mm_sqrt_ps(horizontal_squared);
+
+        // Signed curvature in the horizontal plane, zero where the tangent is vertical
+        __m128 curvature = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(tx, bend_z), _mm_mul_ps(tz, bend_x)),
+                                      _mm_mul_ps(horizontal_squared, horizontal));
+        curvature = _mm_and_ps(_mm_cmpgt_ps(horizontal, _mm_setzero_ps()), curvature);
+
+        __m128 speed = _mm_loadu_ps(&speeds[i]);
+        __m128 acceleration = _mm_mul_ps(_mm_mul_ps(speed, speed), curvature);
+
+        __m128 yaw = _mm_add_ps(_mm_set1_ps(glm::pi<float>()), fast_atan2_4(tx, tz));
+        __m128 pitch = _mm_sub_ps(fast_atan2_4(ty, horizontal), _mm_mul_ps(_mm_set1_ps(PATH_PITCH_PER_SPEED), speed));
+        __m128 roll = _mm_xor_ps(fast_atan2_4(acceleration, _mm_set1_ps(PATH_BANK_ACCELERATION)), _mm_set1_ps(-0.0f));
+        roll = _mm_min_ps(_mm_max_ps(roll, _mm_set1_ps(-PATH_MAX_BANK)), _mm_set1_ps(PATH_MAX_BANK));
+
+        _mm_storeu_ps(&yaws[i], yaw);
+        _mm_storeu_ps(&pitches[i], pitch);
+        _mm_storeu_ps(&rolls[i], roll);
+
+        float position_x[4], position_y[4], position_z[4];
+        _mm_storeu_ps(position_x, px);
+        _mm_storeu_ps(position_y, py);
+        _mm_storeu_ps(position_z, pz);
+        for (int k = 0; k < 4; k++) {
+            positions[i + k] = glm::vec3(position_x[k], position_y[k], position_z[k]);
+        }
+    }
+#endif
+
+    for (; i < end; i++) {
+        unsigned int segment;
+        float t;
+        locate(i, time, segment, t);
+
+        const glm::vec3& a = segments[segment].a;
+        const glm::vec3& b = segments[segment].b;
+        const glm::vec3& c = segments[segment].c;
+        const glm::vec3& d = segments[segment].d;
+
+        // Position and its first and second derivatives from the cubic
+        glm::vec3 position = ((a * t + b) * t + c) * t + d;
+        glm::vec3 tangent = (3.0f * a * t + 2.0f * b) * t + c;
+        glm::vec3 bend = 6.0f * a * t + 2.0f * b;
+
+        float horizontal_squared = tangent.x * tangent.x + tangent.z * tangent.z;
+        float horizontal = std::sqrt(horizontal_squared);
+
+        // Signed curvature in the horizontal plane gives the sideways acceleration to bank against
+        float curvature = (horizontal > 0.0f)
+            ? (tangent.x * bend.z - tangent.z * bend.x) / (horizontal_squared * horizontal)
+            : 0.0f;
+        float acceleration = speeds[i] * speeds[i] * curvature;
+
+        positions[i] = position;
+        yaws[i] = glm::pi<float>() + fast_atan2(tangent.x, tangent.z);
+        pitches[i] = fast_atan2(tangent.y, horizontal) - PATH_PITCH_PER_SPEED * speeds[i];
+        rolls[i] = glm::clamp(-fast_atan2(acceleration, PATH_BANK_ACCELERATION), -PATH_MAX_BANK, PATH_MAX_BANK);
+    }
+}
+
+void PathSystem::evaluate(double time, ThreadPool* pool) {
+    previousPositions.swap(positions);
+    previousYaws.swap(yaws);
+    previousPitches.swap(pitches);
+    previousRolls.swap(rolls);
+    evaluatedTime = time;
+
+    if (pool != nullptr) {
+        pool->parallelFor(targets.size(), PATH_GRAIN_SIZE, [&](size_t begin, size_t end) {
+            evaluateRange(begin, end, time);
+        });
+    } else {
+        evaluateRange(0, targets.size(), time);
+    }
+}
+
+void PathSystem::apply(ThreadPool* pool, float alpha) {
+    // Every agent drives its own node, so ranges of agents can be written in parallel
+    std::vector<unsigned char> stale(targets.size(), 0);
+    bool interpolate = alpha < 1.0f;
+
+    std::function<void(size_t, size_t)> apply_range = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            SceneNode* node = resolveSceneNode(targets[i]);
+            if (node == nullptr) {
+                stale[i] = 1;
+                continue;
+            }
+
+            if (interpolate) {
+                setNodePosition(node, glm::mix(previousPositions[i], positions[i], alpha));
+                setNodeRotation(node, glm::vec3(interpolateAngle(previousPitches[i], pitches[i], alpha),
+                                                interpolateAngle(previousYaws[i], yaws[i], alpha),
+                                                interpolateAngle(previousRolls[i], rolls[i], alpha)));
+            } else {
+                setNodePosition(node, positions[i]);
+                setNodeRotation(node, glm::vec3(pitches[i], yaws[i], rolls[i]));
+            }
+        }
+    };
+
+    if (pool != nullptr) {
+        pool->parallelFor(targets.size(), PATH_GRAIN_SIZE, apply_range);
+    } else {
+        apply_range(0, targets.size());
+    }
+
+    size_t stale_count = std::count(stale.begin(), stale.end(), 1);
+    if (stale_count > 0 && stale_count * 2 >= targets.size()) {
+        removeStaleAgents();
+    }
+}
+
+PathSample PathSystem::sample(size_t agent) const {
+    PathSample result;
+    result.position = positions[agent];
+    result.yaw = yaws[agent];
+    result.pitch = pitches[agent];
+    result.roll = rolls[agent];
+    return result;
+}
+
+/* Moves the last agent into the removed agent's place */
+void PathSystem::removeAgent(size_t agent) {
+    size_t last = targets.size() - 1;
+
+    targets[agent] = targets[last];
+    agentPaths[agent] = agentPaths[last];
+    speeds[agent] = speeds[last];
+    startDistances[agent] = startDistances[last];
+    positions[agent] = positions[last];
+    yaws[agent] = yaws[last];
+    pitches[agent] = pitches[last];
+    rolls[agent] = rolls[last];
+    previousPositions[agent] = previousPositions[last];
+    previousYaws[agent] = previousYaws[last];
+    previousPitches[agent] = previousPitches[last];
+    previousRolls[agent] = previousRolls[last];
+
+    targets.pop_back();
+    agentPaths.pop_back();
+    speeds.pop_back();
+    startDistances.pop_back();
+    positions.pop_back();
+    yaws.pop_back();
+    pitches.pop_back();
+    rolls.pop_back();
+    previousPositions.pop_back();
+    previousYaws.pop_back();
+    previousPitches.pop_back();
+    previousRolls.pop_back();
+}
+
+void PathSystem::removeStaleAgents() {
+    size_t i = 0;
+    while (i < targets.size()) {
+        if (resolveSceneNode(targets[i]) == nullptr) {
+            removeAgent(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+
+std::vector<glm::vec3> createLissajousRoute(float angle, float scale, unsigned int pointCount) {
+    // Constants of simpleHeadingAnimation()
+    const float pathSize = 15;
+    const float circuitSpeed = 0.8f;
+    const float period = 2.0f * glm::pi<float>() / circuitSpeed;
+
+    float sine = std::sin(angle);
+    float cosine = std::cos(angle);
+    std::vector<glm::vec3> points;
+
+    for (unsigned int i = 0; i < pointCount; i++) {
+        float time = period * (float)i / (float)pointCount;
+        float x = scale * pathSize * std::sin(2 * time * circuitSpeed);
+        float z = scale * 3 * pathSize * std::cos(time * circuitSpeed);
+
+        points.push_back(glm::vec3(cosine * x + sine * z, 0.0f, -sine * x + cosine * z));
+    }
+    return points;
+}
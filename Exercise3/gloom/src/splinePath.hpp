@@ -0,0 +1,106 @@
+#ifndef SPLINE_PATH_HPP
+#define SPLINE_PATH_HPP
+#pragma once
+
+
+// System headers
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// Local headers
+#include "sceneGraph.hpp"
+#include "threadPool.hpp"
+
+
+// Position and attitude of an agent on its path
+struct PathSample {
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+    float roll;
+};
+
+
+// Closed Catmull-Rom paths and the agents (scene nodes) travelling along them at constant speed.
+// All paths share flat segment and arc length arrays, and agents are stored as structure of arrays,
+// so that evaluate() is a tight loop over all agents with no per-agent allocations or virtual calls,
+// evaluating four agents at a time with SSE where available.
+class PathSystem {
+public:
+    PathSystem() : evaluatedTime(0.0) { }
+
+    // Adds a closed path through at least four control points and returns its index
+    unsigned int addPath(const std::vector<glm::vec3>& controlPoints);
+
+    // Arc length of a path
+    float pathLength(unsigned int path) const { return lengths[path]; }
+
+    // Adds an agent moving the target node along path at speed units per second, starting startDistance along it
+    size_t addAgent(SceneNodeHandle target, unsigned int path, float speed, float startDistance = 0.0f);
+
+    // Computes the position, heading, pitch and roll of every agent at the given time, keeping the results of the
+    // previous call. If a pool is given, ranges of agents are evaluated in parallel.
+    void evaluate(double time, ThreadPool* pool = nullptr);
+
+    // Writes the results of the last evaluate() into the agents' nodes, interpolated from the previous evaluate()
+    // by alpha in [0, 1]. Agents whose node has been destroyed are skipped and removed once they make up half of all agents.
+    void apply(ThreadPool* pool = nullptr, float alpha = 1.0f);
+
+    // Removes the agents whose node has been destroyed
+    void removeStaleAgents();
+
+    size_t agentCount() const { return targets.size(); }
+    PathSample sample(size_t agent) const;
+
+private:
+    void locate(size_t agent, double time, unsigned int& segment, float& t) const;
+    void evaluateRange(size_t begin, size_t end, double time);
+    void removeAgent(size_t agent);
+
+    // Per path: first segment and arc length table entry in the shared arrays, number of segments and total length
+    std::vector<unsigned int> firstSegments;
+    std::vector<unsigned int> segmentCounts;
+    std::vector<unsigned int> firstTableEntries;
+    std::vector<float> lengths;
+
+    // Cubic coefficients of a segment, position(t) = ((a * t + b) * t + c) * t + d for t in [0, 1].
+    // Kept together, as an agent always needs all four and agents on different paths access segments at random.
+    struct SplineSegment {
+        glm::vec3 a;
+        glm::vec3 b;
+        glm::vec3 c;
+        glm::vec3 d;
+    };
+    std::vector<SplineSegment> segments;
+
+    // Per path: the spline parameter (segment index + t) at equally spaced distances along the path
+    std::vector<float> arcLengthTable;
+
+    // Per agent
+    std::vector<SceneNodeHandle> targets;
+    std::vector<unsigned int> agentPaths;
+    std::vector<float> speeds;
+    std::vector<float> startDistances;
+
+    // Results of the last evaluate(), per agent
+    std::vector<glm::vec3> positions;
+    std::vector<float> yaws;
+    std::vector<float> pitches;
+    std::vector<float> rolls;
+
+    // Results of the evaluate() before it, and the time of the last one
+    std::vector<glm::vec3> previousPositions;
+    std::vector<float> previousYaws;
+    std::vector<float> previousPitches;
+    std::vector<float> previousRolls;
+    double evaluatedTime;
+};
+
+
+// Control points approximating the path of simpleHeadingAnimation(), rotated by angle about the y axis and scaled
+std::vector<glm::vec3> createLissajousRoute(float angle, float scale, unsigned int pointCount = 16);
+
+
+#endif
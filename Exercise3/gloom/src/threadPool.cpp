@@ -0,0 +1,147 @@
+#include "threadPool.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+
+// Identifies which pool (if any) the current thread is a worker of, and which queue it owns
+static thread_local const ThreadPool* tWorkerPool = nullptr;
+static thread_local unsigned int tWorkerQueue = 0;
+
+
+ThreadPool::ThreadPool(unsigned int workerCount) : queuedTasks(0), stopping(false) {
+    if (workerCount == 0) {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = (hardwareThreads > 1) ? hardwareThreads - 1 : 1;
+    }
+
+    for (unsigned int i = 0; i < workerCount + 1; i++) {
+        queues.emplace_back(new TaskQueue());
+    }
+
+    for (unsigned int i = 0; i < workerCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i + 1);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+unsigned int ThreadPool::currentQueueIndex() const {
+    return (tWorkerPool == this) ? tWorkerQueue : 0;
+}
+
+void ThreadPool::run(TaskGroup& group, std::function<void()> task) {
+    group.pending++;
+
+    TaskQueue& queue = *queues[currentQueueIndex()];
+    {
+        // Counted under the queue lock, as tasks are only popped (and uncounted) under it, so the count never wraps
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(Task{ std::move(task), &group });
+        queuedTasks++;
+    }
+
+    // Taking the lock orders the notification after a worker's check of queuedTasks, so the wake up cannot be lost
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wakeCondition.notify_one();
+}
+
+/* Pops from the back of the thread's own queue, otherwise steals from the front of the other queues */
+bool ThreadPool::findTask(unsigned int queueIndex, Task& task) {
+    if (queuedTasks.load() == 0) {
+        return false;
+    }
+
+    {
+        TaskQueue& own = *queues[queueIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queuedTasks--;
+            return true;
+        }
+    }
+
+    for (size_t offset = 1; offset < queues.size(); offset++) {
+        TaskQueue& victim = *queues[(queueIndex + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queuedTasks--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(Task& task) {
+    PROFILE_ZONE("Pool task");
+    task.function();
+    task.group->pending--;
+}
+
+void ThreadPool::workerLoop(unsigned int queueIndex) {
+    tWorkerPool = this;
+    tWorkerQueue = queueIndex;
+    PROFILE_THREAD("Thread pool worker");
+
+    while (true) {
+        Task task;
+        if (findTask(queueIndex, task)) {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeCondition.wait(lock, [this] { return stopping || queuedTasks.load() > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+    unsigned int queueIndex = currentQueueIndex();
+
+    while (group.pending.load() > 0) {
+        Task task;
+        if (findTask(queueIndex, task)) {
+            execute(task);
+        } else {
+            // The remaining tasks of the group are running on other threads
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& task) {
+    grainSize = std::max<size_t>(grainSize, 1);
+
+    // Not worth the overhead of queueing
+    if (count <= grainSize) {
+        if (count > 0) {
+            task(0, count);
+        }
+        return;
+    }
+
+    TaskGroup group;
+    for (size_t begin = 0; begin < count; begin += grainSize) {
+        size_t end = std::min(begin + grainSize, count);
+        run(group, [&task, begin, end] { task(begin, end); });
+    }
+    wait(group);
+}
@@ -0,0 +1,84 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+#pragma once
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Counts the unfinished tasks spawned into it. ThreadPool::wait() returns once all of them have completed.
+class TaskGroup {
+public:
+    TaskGroup() : pending(0) { }
+
+private:
+    friend class ThreadPool;
+
+    TaskGroup(TaskGroup const &) = delete;
+    TaskGroup & operator =(TaskGroup const &) = delete;
+
+    std::atomic<unsigned int> pending;
+};
+
+
+// A fixed set of worker threads, each with its own task deque.
+// Workers pop their newest task from the back of their own deque and steal the oldest task
+// from the front of another worker's deque when they run out of work.
+// Threads that wait for a TaskGroup run queued tasks in the meantime, so tasks may spawn and wait on nested groups.
+class ThreadPool {
+public:
+    // workerCount = 0 starts one worker less than the number of hardware threads, as the calling thread helps out while waiting
+    explicit ThreadPool(unsigned int workerCount = 0);
+    ~ThreadPool();
+
+    unsigned int workerCount() const { return (unsigned int)workers.size(); }
+
+    // Queues a task as part of group
+    void run(TaskGroup& group, std::function<void()> task);
+
+    // Runs queued tasks until every task in group has finished
+    void wait(TaskGroup& group);
+
+    // Calls task(begin, end) for consecutive ranges of at most grainSize elements covering [0, count) and waits for all of them.
+    // Ranges are fixed by count and grainSize only, so the partitioning is the same on every run.
+    void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& task);
+
+private:
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool & operator =(ThreadPool const &) = delete;
+
+    struct Task {
+        std::function<void()> function;
+        TaskGroup* group;
+    };
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(unsigned int queueIndex);
+    bool findTask(unsigned int queueIndex, Task& task);
+    void execute(Task& task);
+    unsigned int currentQueueIndex() const;
+
+    // Queue 0 is shared by all threads that are not workers of this pool; queue i + 1 belongs to worker i
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::atomic<unsigned int> queuedTasks;
+    std::mutex sleepMutex;
+    std::condition_variable wakeCondition;
+    bool stopping;
+};
+
+
+#endif
@@ -9,9 +9,6 @@
 // Returns a random float between 0 and 1
 float randomUniformFloat();
 
-// Return the amount of time elapsed since the LAST TIME this function was called, in seconds.
-double getTimeDeltaSeconds();
-
 struct Heading {
     float x;
     float z;
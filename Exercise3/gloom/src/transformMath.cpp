@@ -0,0 +1,152 @@
+#include "transformMath.hpp"
+#include "simd.hpp"
+
+#include <cmath>
+
+
+/* Writes the pivot adjusted translation and a 3x3 rotation (given row by row) into a column-major matrix */
+static glm::mat4 build_pivot_transform(glm::vec3 position, glm::vec3 reference,
+                                       float r00, float r01, float r02,
+                                       float r10, float r11, float r12,
+                                       float r20, float r21, float r22) {
+    glm::mat4 result;
+
+    result[0] = glm::vec4(r00, r10, r20, 0.0f);
+    result[1] = glm::vec4(r01, r11, r21, 0.0f);
+    result[2] = glm::vec4(r02, r12, r22, 0.0f);
+
+    // Rotating about the reference point moves the origin to reference - R * reference
+    result[3] = glm::vec4(
+        position.x + reference.x - (r00 * reference.x + r01 * reference.y + r02 * reference.z),
+        position.y + reference.y - (r10 * reference.x + r11 * reference.y + r12 * reference.z),
+        position.z + reference.z - (r20 * reference.x + r21 * reference.y + r22 * reference.z),
+        1.0f);
+
+    return result;
+}
+
+/* Composes Rx * Ry * Rz analytically and applies the position and reference point */
+glm::mat4 composeEulerTransform(glm::vec3 position, glm::vec3 rotation, glm::vec3 referencePoint) {
+    float sx = std::sin(rotation.x), cx = std::cos(rotation.x);
+    float sy = std::sin(rotation.y), cy = std::cos(rotation.y);
+    float sz = std::sin(rotation.z), cz = std::cos(rotation.z);
+
+    return build_pivot_transform(position, referencePoint,
+        cy * cz,                  -cy * sz,                  sy,
+        sx * sy * cz + cx * sz,   -sx * sy * sz + cx * cz,   -sx * cy,
+        -cx * sy * cz + sx * sz,  cx * sy * sz + sx * cz,    cx * cy);
+}
+
+/* Converts the quaternion to a rotation matrix in place and applies the position and reference point */
+glm::mat4 composeQuaternionTransform(glm::vec3 position, glm::quat rotation, glm::vec3 referencePoint) {
+    float xx = rotation.x * rotation.x, yy = rotation.y * rotation.y, zz = rotation.z * rotation.z;
+    float xy = rotation.x * rotation.y, xz = rotation.x * rotation.z, yz = rotation.y * rotation.z;
+    float wx = rotation.w * rotation.x, wy = rotation.w * rotation.y, wz = rotation.w * rotation.z;
+
+    return build_pivot_transform(position, referencePoint,
+        1.0f - 2.0f * (yy + zz),  2.0f * (xy - wz),         2.0f * (xz + wy),
+        2.0f * (xy + wz),         1.0f - 2.0f * (xx + zz),  2.0f * (yz - wx),
+        2.0f * (xz - wy),         2.0f * (yz + wx),         1.0f - 2.0f * (xx + yy));
+}
+
+void composeEulerTransforms(const glm::vec3* positions, const glm::vec3* rotations, const glm::vec3* referencePoints,
+                            glm::mat4* results, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        results[i] = composeEulerTransform(positions[i], rotations[i], referencePoints[i]);
+    }
+}
+
+
+// --- SIMD kernels ---
+// A column of parent * local is a linear combination of the parent's columns,
+// weighted by the four entries of the corresponding local column.
+
+#if defined(SIMD_AVX)
+
+/* Multiplies two matrices, computing two result columns per 256 bit register */
+static inline void multiply_transform_simd(const float* parent, const float* local, float* result) {
+    __m256 p0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(parent + 0));
+    __m256 p1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(parent + 4));
+    __m256 p2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(parent + 8));
+    __m256 p3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(parent + 12));
+
+    for (int column = 0; column < 4; column += 2) {
+        __m256 l = _mm256_loadu_ps(local + column * 4);
+
+        __m256 r = _mm256_mul_ps(p0, _mm256_permute_ps(l, 0x00));
+        r = _mm256_add_ps(r, _mm256_mul_ps(p1, _mm256_permute_ps(l, 0x55)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(p2, _mm256_permute_ps(l, 0xAA)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(p3, _mm256_permute_ps(l, 0xFF)));
+
+        _mm256_storeu_ps(result + column * 4, r);
+    }
+}
+
+#elif defined(SIMD_SSE)
+
+/* Multiplies two matrices, computing one result column per 128 bit register */
+static inline void multiply_transform_simd(const float* parent, const float* local, float* result) {
+    __m128 p0 = _mm_loadu_ps(parent + 0);
+    __m128 p1 = _mm_loadu_ps(parent + 4);
+    __m128 p2 = _mm_loadu_ps(parent + 8);
+    __m128 p3 = _mm_loadu_ps(parent + 12);
+
+    for (int column = 0; column < 4; column++) {
+        __m128 l = _mm_loadu_ps(local + column * 4);
+
+        __m128 r = _mm_mul_ps(p0, _mm_shuffle_ps(l, l, 0x00));
+        r = _mm_add_ps(r, _mm_mul_ps(p1, _mm_shuffle_ps(l, l, 0x55)));
+        r = _mm_add_ps(r, _mm_mul_ps(p2, _mm_shuffle_ps(l, l, 0xAA)));
+        r = _mm_add_ps(r, _mm_mul_ps(p3, _mm_shuffle_ps(l, l, 0xFF)));
+
+        _mm_storeu_ps(result + column * 4, r);
+    }
+}
+
+#else
+
+/* Portable fallback with the same evaluation order as the SIMD kernels */
+static inline void multiply_transform_simd(const float* parent, const float* local, float* result) {
+    for (int column = 0; column < 4; column++) {
+        float l[4] = { local[column * 4 + 0], local[column * 4 + 1], local[column * 4 + 2], local[column * 4 + 3] };
+
+        for (int row = 0; row < 4; row++) {
+            result[column * 4 + row] = parent[row] * l[0] + parent[4 + row] * l[1]
+                                     + parent[8 + row] * l[2] + parent[12 + row] * l[3];
+        }
+    }
+}
+
+#endif
+
+
+glm::mat4 multiplyTransform(const glm::mat4& parent, const glm::mat4& local) {
+    glm::mat4 result;
+    multiply_transform_simd(&parent[0][0], &local[0][0], &result[0][0]);
+    return result;
+}
+
+void multiplyTransforms(const glm::mat4* parents, const glm::mat4* locals, glm::mat4* results, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        multiply_transform_simd(&parents[i][0][0], &locals[i][0][0], &results[i][0][0]);
+    }
+}
+
+void multiplyTransforms(const glm::mat4& parent, const glm::mat4* locals, glm::mat4* results, size_t count) {
+    const float* parent_values = &parent[0][0];
+
+    for (size_t i = 0; i < count; i++) {
+        multiply_transform_simd(parent_values, &locals[i][0][0], &results[i][0][0]);
+    }
+}
+
+float interpolateAngle(float from, float to, float alpha) {
+    const float pi = 3.14159265358979323846f;
+    const float two_pi = 6.28318530717958647692f;
+
+    // Difference wrapped to [-pi, pi)
+    float difference = to - from;
+    difference -= two_pi * std::floor((difference + pi) / two_pi);
+
+    return from + difference * alpha;
+}
@@ -0,0 +1,43 @@
+#ifndef TRANSFORM_MATH_HPP
+#define TRANSFORM_MATH_HPP
+#pragma once
+
+
+// System headers
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+
+// The batch kernels use AVX when the compiler targets it (e.g. -mavx or -march=native),
+// otherwise SSE on x86 and a plain scalar loop everywhere else.
+
+
+// Builds the local transformation of a scene node directly from its position, Euler rotation and reference point.
+// Equivalent to translate(position) * translate(reference) * rotate_x * rotate_y * rotate_z * translate(-reference),
+// but computed with one sin/cos per axis and no intermediate matrices.
+glm::mat4 composeEulerTransform(glm::vec3 position, glm::vec3 rotation, glm::vec3 referencePoint);
+
+// Same as composeEulerTransform, but with the rotation given as a (normalised) quaternion
+glm::mat4 composeQuaternionTransform(glm::vec3 position, glm::quat rotation, glm::vec3 referencePoint);
+
+// Builds count local transformations from arrays of positions, Euler rotations and reference points
+void composeEulerTransforms(const glm::vec3* positions, const glm::vec3* rotations, const glm::vec3* referencePoints,
+                            glm::mat4* results, size_t count);
+
+// Returns parent * local using the widest SIMD instructions available
+glm::mat4 multiplyTransform(const glm::mat4& parent, const glm::mat4& local);
+
+// Computes results[i] = parents[i] * locals[i] for count matrices
+void multiplyTransforms(const glm::mat4* parents, const glm::mat4* locals, glm::mat4* results, size_t count);
+
+// Computes results[i] = parent * locals[i] for count matrices sharing the same parent, such as the children of a node
+void multiplyTransforms(const glm::mat4& parent, const glm::mat4* locals, glm::mat4* results, size_t count);
+
+// Interpolates from one angle to another along the shorter way round, so that an angle wrapping from 2pi to 0
+// (or from pi to -pi) between two simulation ticks does not turn backwards through the whole circle
+float interpolateAngle(float from, float to, float alpha);
+
+
+#endif